@@ -0,0 +1,41 @@
+#ifndef __ACTIVITY_H
+#define __ACTIVITY_H
+
+#include <stdint.h>
+
+/*
+    Activity history. Steps and movement intensity are kept in fixed width
+    15 minute bins: 12 bits of steps taken in the bin, the difference of
+    the BMA423's running counter, and 4 bits of intensity. New bins go to a
+    ring in RTC memory that survives a restart, and are written to SPIFFS a
+    whole block at a time. Gadgetbridge receives them as Bangle.js "act"
+    records, queued as whole lines for the TX task, from a cursor kept in
+    NVS so an interrupted sync picks up where it stopped.
+*/
+
+#define ACTIVITY_BIN_S          (15 * 60)
+#define ACTIVITY_BLOCK_BINS     256
+#define ACTIVITY_RTC_BINS       (2 * ACTIVITY_BLOCK_BINS)
+
+//! Blocks per history file, two files are kept
+#ifndef ACTIVITY_FILE_BLOCKS
+#define ACTIVITY_FILE_BLOCKS    32
+#endif
+
+//! Sample the accelerometer for movement this often
+#define ACTIVITY_SAMPLE_MS      60000
+//! Summed change in raw acceleration per sample for one step of intensity
+#define ACTIVITY_MOVEMENT_SCALE 64
+
+#define ACTIVITY_SYNC_PERIOD_MS 50
+#define ACTIVITY_CURSOR_SAVE    64
+
+void setupActivity();
+//! SPIFFS is mounted, nothing is recorded before
+void activity_storage_ready();
+void activity_poll();
+//! Send the history from fromTime (seconds), 0 to resume from the saved cursor
+void activity_sync(uint32_t fromTime);
+void activity_report();
+
+#endif /*__ACTIVITY_H */
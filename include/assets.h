@@ -0,0 +1,41 @@
+#ifndef __ASSETS_H
+#define __ASSETS_H
+
+#include <stdint.h>
+
+/*
+    Images from the "assets" flash partition instead of the application
+    image, so they can be flashed on their own and do not weigh on every
+    firmware update. tools/mkassets.py builds the partition image.
+
+    The partition is memory mapped once at startup and each asset is an
+    lv_img_dsc_t pointing straight into flash, nothing is copied. Assets
+    are looked up by the FNV-1a hash of their name, ASSET_SRC(bg, NULL)
+    works that out at compile time.
+
+    Layout, little endian:
+        header  "WAS1", u32 asset count, u32 image size, u32 reserved
+        index   u32 id, u32 offset, u32 size, u32 lv_img_header_t,
+                char[24] name, sorted by id
+        data    each asset 4 byte aligned
+*/
+
+#define ASSET_PARTITION_LABEL   "assets"
+#define ASSET_PARTITION_SUBTYPE 0x40
+#define ASSET_NAME_SIZE         24
+#define ASSET_MAX               48
+
+constexpr uint32_t asset_id(const char *name, uint32_t hash = 2166136261u)
+{
+    return *name ? asset_id(name + 1, (hash ^ (uint8_t)*name) * 16777619u) : hash;
+}
+
+//! The asset called name, or fallback (a symbol, say) when it is not in the partition
+#define ASSET_SRC(name, fallback)   asset_src(asset_id(#name), fallback)
+
+void setupAssets();
+const lv_img_dsc_t *asset_img(uint32_t id);
+const void *asset_src(uint32_t id, const void *fallback);
+void assets_report();
+
+#endif /*__ASSETS_H */
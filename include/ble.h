@@ -1,7 +1,26 @@
 #ifndef __BLE_H
 #define __BLE_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+    BLE_TX_OK,
+    BLE_TX_CONGESTED,
+    BLE_TX_BUSY,
+    BLE_TX_DISCONNECTED,
+} ble_tx_t;
+
 void setupBle();
 void bluetooth_event_cb();
+bool ble_connected();
+//! Bytes that fit in one notification
+uint16_t ble_payload_size();
+//! Send one notification of at most ble_payload_size() bytes, never drops silently.
+//! Only the TX task calls it, so the packets of a message are never interleaved.
+ble_tx_t ble_notify_packet(const uint8_t *data, size_t len, TickType_t wait);
+//! Handle one line from the phone, called from loop() through rx_poll()
+void ble_process_message(char *msg, size_t len);
 
 #endif /*__BLE_H */
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef __BLEND_H
+#define __BLEND_H
+
+// Build with -D BLEND_GPU=1 to hand LVGL's opaque fills and copies to the
+// lib/blend565 kernels. Off until test_blend on the watch shows them ahead
+// of LVGL's own loops there.
+#ifndef BLEND_GPU
+#define BLEND_GPU 0
+#endif
+
+void setupBlend();
+void blend_fill(lv_color_t *dest, uint32_t length, lv_color_t color);
+void blend_map(lv_color_t *dest, const lv_color_t *src, uint32_t length, lv_opa_t opa);
+
+#endif /*__BLEND_H */
@@ -0,0 +1,36 @@
+#ifndef __BLERX_H
+#define __BLERX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Incoming Gadgetbridge messages. The BLE task only files each complete
+    line into one of RX_SLOTS preallocated slots by priority class, and
+    loop() handles them one at a time, highest class first, so an incoming
+    call is never stuck behind a backlog of notifications. Messages that
+    only carry the latest state, music info and weather, replace a queued
+    one of the same type instead of waiting behind it.
+*/
+
+//! Long notification bodies fit, the slots live in PSRAM
+#define MAX_MESSAGE_SIZE    4096
+#define RX_SLOTS            8
+
+typedef enum {
+    RX_CLASS_CALL,
+    RX_CLASS_NORMAL,
+    RX_CLASS_BULK,
+    RX_CLASSES,
+} rx_class_t;
+
+void setupRx();
+//! From the BLE task, msg is one line without the newline
+bool rx_push(const char *msg, size_t len);
+//! From loop(), handles the most urgent queued message
+void rx_poll();
+//! The handler has just alerted the user, records receive to vibrate latency
+void rx_alerted();
+void rx_report();
+
+#endif /*__BLERX_H */
@@ -0,0 +1,27 @@
+#ifndef __BLETX_H
+#define __BLETX_H
+
+#include <stdint.h>
+
+/*
+    Outbound Gadgetbridge messages. Each message is formatted straight into
+    one of TX_SLOTS preallocated slots and the caller returns at once. A
+    task on the BLE core packs as many queued lines as fit into each
+    notification for the negotiated MTU, and when the stack is congested it
+    backs off and sends the same packet again instead of dropping it.
+*/
+
+#define TX_SLOTS            8
+#define TX_MSG_SIZE         160
+#define TX_BACKOFF_MS       10
+#define TX_BACKOFF_MAX_MS   320
+
+void setupTx();
+//! Queue one JSON line, printf style, without the trailing newline
+bool tx_send(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+//! Same, for replies to something the user did, their latency is reported
+bool tx_action(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+uint8_t tx_depth();
+void tx_report();
+
+#endif /*__BLETX_H */
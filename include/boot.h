@@ -0,0 +1,17 @@
+#ifndef __BOOT_H
+#define __BOOT_H
+
+#define BOOT_MAX_STAGES     24
+
+//! Core the deferred subsystems start on, loop() runs on the other one
+#ifndef BOOT_DEFERRED_CORE
+#define BOOT_DEFERRED_CORE  0
+#endif
+
+//! Record that a boot stage has finished, callable from any task
+void boot_stage(const char *name);
+void boot_first_frame();
+void boot_connectable();
+void boot_report();
+
+#endif /*__BOOT_H */
@@ -0,0 +1,20 @@
+#ifndef __CALL_H
+#define __CALL_H
+
+/*
+    Incoming call screen. It is built once at startup on the top layer and
+    only has its text swapped and shown when a call comes in, so a ringing
+    phone never waits on widget creation or the LVGL heap.
+*/
+
+#define CALL_NAME_SIZE      48
+#define CALL_NUMBER_SIZE    24
+#define CALL_RING_MS        1500
+#define CALL_RING_MAX       20
+
+void setupCall();
+void call_show(const char *name, const char *number);
+void call_hide();
+bool call_active();
+
+#endif /*__CALL_H */
@@ -0,0 +1,42 @@
+#ifndef __FONTS_H
+#define __FONTS_H
+
+#include <stdint.h>
+
+/*
+    Text font with Unicode coverage. Glyphs come from the compiled-in font
+    first and otherwise from a font pack on SPIFFS, see tools/bdf2pack.py.
+    Only the pack's block table is held in RAM. A glyph is looked up in
+    the pack's index on first use and its bitmap kept in an LRU cache in
+    PSRAM. Glyphs the pack lacks are cached too, so they are only searched
+    for once.
+
+    Pack layout, little endian:
+        header      "WFP1", u16 line height, i16 base line, u8 bpp,
+                    u8[3] reserved, u32 block count, u32 glyph count
+        blocks      u32 code point >> 8, u32 first glyph, u32 glyph count
+        glyphs      u32 code point, u32 bitmap offset, u8 advance,
+                    u8 width, u8 height, i8 x offset, i8 y offset, u8[3]
+        bitmaps     rows packed back to back at bpp bits per pixel
+*/
+
+#define FONT_PACK_PATH          "/font.pack"
+
+//! Glyphs held in the cache and the largest bitmap a cache slot can hold
+#ifndef FONT_CACHE_GLYPHS
+#define FONT_CACHE_GLYPHS       128
+#endif
+#ifndef FONT_GLYPH_MAX_BYTES
+#define FONT_GLYPH_MAX_BYTES    128
+#endif
+
+#define FONT_MAX_BLOCKS         512
+
+void setupFonts();
+//! Open the pack, needs SPIFFS mounted
+void fonts_load_pack();
+//! Compiled-in font with the pack as fallback
+const lv_font_t *font_text();
+void fonts_report();
+
+#endif /*__FONTS_H */
@@ -1 +1,19 @@
-void process_gadgetbridge_json(const char* json_string);
\ No newline at end of file
+#ifndef __GADGETBRIDGE_H
+#define __GADGETBRIDGE_H
+
+//! Check the battery this often, and send it when it moved enough or the interval ran out
+#ifndef STATUS_POLL_MS
+#define STATUS_POLL_MS          30000
+#endif
+#ifndef STATUS_MAX_INTERVAL_MS
+#define STATUS_MAX_INTERVAL_MS  (10 * 60 * 1000)
+#endif
+#define STATUS_BAT_DELTA        2
+#define STATUS_VOLT_DELTA_MV    50
+
+//! Parsed in place, json_string must stay valid while it is handled
+void process_gadgetbridge_json(char* json_string);
+void gadgetbridge_status_poll();
+void gadgetbridge_report();
+
+#endif /*__GADGETBRIDGE_H */
@@ -27,9 +27,13 @@ typedef enum {
     LV_STATUS_BAR_BLUETOOTH = 3,
 } lv_icon_status_bar_t;
 
+#define SWITCH_MAX_COUNT    6
+
 class Switch
 {
 public:
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
     typedef struct {
         const char *name;
         void (*cb)(uint8_t, bool);
@@ -46,14 +50,16 @@ private:
     static Switch *_switch;
     lv_obj_t *_swCont = nullptr;
     uint8_t _count;
-    lv_obj_t **_sw = nullptr;
-    switch_cfg_t *_cfg = nullptr;
+    lv_obj_t *_sw[SWITCH_MAX_COUNT];
+    switch_cfg_t _cfg[SWITCH_MAX_COUNT];
     lv_obj_t *_exitBtn = nullptr;
     exit_cb _exit_cb = nullptr;
 };
 class MBox
 {
 public:
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
     MBox();
     ~MBox();
     void create(const char *text, lv_event_cb_t event_cb, const char **btns = nullptr, lv_obj_t *par = nullptr);
@@ -67,6 +73,8 @@ private:
 class Keyboard
 {
 public:
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
     typedef enum {
         KB_EVENT_OK,
         KB_EVENT_EXIT,
@@ -80,8 +88,10 @@ public:
     void setKeyboardEvent(kb_event_cb cb);
     const char *getText();
     void hidden(bool en = true);
+    void clear();
 private:
     lv_obj_t *_kbCont = nullptr;
+    lv_obj_t *_ta = nullptr;
     kb_event_cb _cb = nullptr;
     static const char *btnm_mapplus[10][23];
     static Keyboard *_kb;
@@ -91,6 +101,8 @@ private:
 class Preload
 {
 public:
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
     Preload();
     ~Preload();
     void create(lv_obj_t *parent = nullptr);
@@ -103,6 +115,8 @@ private:
 class List
 {
 public:
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
     typedef void(*list_event_cb)(const char *);
     List();
     ~List();
@@ -112,8 +126,12 @@ public:
     void hidden(bool en = true);
     static void __list_event_cb(lv_obj_t *obj, lv_event_t event);
     void setListCb(list_event_cb cb);
+    void clear();
+    void beginUpdate();
+    void endUpdate();
 private:
     lv_obj_t *_listCont = nullptr;
+    lv_layout_t _layout = LV_LAYOUT_OFF;
     static List *_list ;
     list_event_cb _cb = nullptr;
 };
@@ -121,6 +139,8 @@ private:
 class Task
 {
 public:
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
     Task();
     ~Task();
     void create(lv_task_cb_t cb, uint32_t period = 1000, lv_task_prio_t prio = LV_TASK_PRIO_LOW);
@@ -155,6 +175,10 @@ private:
     const int8_t iconOffset = -5;
 };
 
+#ifndef MENU_BENCH_ENTRIES
+#define MENU_BENCH_ENTRIES      48
+#endif
+
 class MenuBar
 {
 public:
@@ -171,16 +195,34 @@ public:
     lv_obj_t *self() const;
     void hidden(bool en = true);
     lv_obj_t *obj(int index) const;
+    int indexOf(const lv_obj_t *obj) const;
+    static void __view_event_cb(lv_obj_t *obj, lv_event_t event);
+    static void bench(int count);
 private:
-    lv_obj_t *_cont, *_view, *_exit, * *_obj;
+    //! Only the visible tile and its neighbours exist, the rest are rebound on scroll
+    enum { TILE_SLOTS = 3 };
+    typedef struct {
+        lv_obj_t *cont;
+        lv_obj_t *img;
+        lv_obj_t *label;
+        int index;
+    } tile_t;
+    void load(int center);
+    void bind(tile_t *tile, int index);
+    static MenuBar *_menu;
+    lv_obj_t *_cont, *_view, *_exit;
+    tile_t _tiles[TILE_SLOTS];
+    lv_menu_config_t *_cfg;
+    lv_event_cb_t _event_cb;
     lv_point_t *_vp ;
+    lv_coord_t _w, _h;
     int _count = 0;
 };
 
 void setupGui();
 void updateStepCounter(uint32_t counter);
 void updateBatteryIcon(lv_icon_battery_t index);
-void wifi_list_add(const char *ssid);
+void wifi_scan_done();
 void wifi_connect_status(bool result);
 void updateBatteryLevel();
 
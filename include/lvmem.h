@@ -0,0 +1,42 @@
+#ifndef __LVMEM_H
+#define __LVMEM_H
+
+/*
+    LVGL heap backend. lv_conf.h belongs to the TTGO library, so instead of
+    LV_MEM_CUSTOM the linker wraps lv_mem_alloc/free/realloc (see the
+    -Wl,--wrap flags in platformio.ini). LVGL's own pool then only serves
+    lv_mem_buf_get(), i.e. the draw buffers, which stay in internal RAM.
+
+    Allocations of LVMEM_PSRAM_THRESHOLD bytes and up (label text, button
+    maps, list and keyboard internals) go to PSRAM, smaller ones to
+    internal RAM. Between lvmem_arena_begin() and lvmem_arena_end() every
+    allocation is bumped out of a PSRAM arena instead, and
+    lvmem_arena_release() frees the whole arena in O(1). Everything built
+    inside an arena must be deleted before the arena is released; an arena
+    that still has live blocks is only reused once they are all freed.
+    Anything that outlives the screen, like a function-static lv_style_t
+    shared by every instance, has to be set up between
+    lvmem_arena_suspend() and lvmem_arena_resume().
+*/
+
+#ifndef LVMEM_PSRAM_THRESHOLD
+#define LVMEM_PSRAM_THRESHOLD   256
+#endif
+
+#ifndef LVMEM_ARENA_SIZE
+#define LVMEM_ARENA_SIZE        (24 * 1024)
+#endif
+
+#define LVMEM_ARENA_COUNT       4
+#define LVMEM_NO_ARENA          -1
+
+int lvmem_arena_begin(const char *name);
+void lvmem_arena_end();
+void lvmem_arena_release(int arena);
+//! Allocate outside the active arena until resumed, returns the arena to resume
+int lvmem_arena_suspend();
+void lvmem_arena_resume(int arena);
+uint32_t lvmem_used();
+void lvmem_report();
+
+#endif /*__LVMEM_H */
@@ -16,4 +16,5 @@ EventGroupHandle_t* get_isr_group();
 #define WATCH_FLAG_SLEEP_MODE   _BV(1)
 #define WATCH_FLAG_SLEEP_EXIT   _BV(2)
 #define WATCH_FLAG_BMA_IRQ      _BV(3)
-#define WATCH_FLAG_AXP_IRQ      _BV(4)
\ No newline at end of file
+#define WATCH_FLAG_AXP_IRQ      _BV(4)
+#define WATCH_FLAG_RTC_IRQ      _BV(5)
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __MUSIC_H
+#define __MUSIC_H
+
+#include <stdint.h>
+
+/*
+    Media control screen for the phone's player. It is preloaded at startup
+    and pinned in the screen cache. Gadgetbridge musicinfo and musicstate
+    messages only touch the widgets whose value changed, and while playing
+    the position is advanced locally once a second, which redraws just the
+    progress bar and its time label.
+*/
+
+#define MUSIC_TEXT_SIZE     64
+#define MUSIC_TICK_MS       1000
+
+void setupMusic();
+void music_event_cb();
+void music_set_info(const char *artist, const char *album, const char *track, int32_t duration);
+//! state is "play", "pause" or "stop", position in seconds or -1 if not sent
+void music_set_state(const char *state, int32_t position);
+void music_report();
+
+#endif /*__MUSIC_H */
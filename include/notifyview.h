@@ -0,0 +1,29 @@
+#ifndef __NOTIFYVIEW_H
+#define __NOTIFYVIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "blerx.h"
+
+/*
+    Notification viewer. The header goes up at once and the body is only
+    wrapped as far as the page being shown, with _lv_txt_get_next_line()
+    one line at a time. Line starts are cached, so paging back costs no
+    measuring, and a low priority task lays out the rest to count the
+    pages. The view is built once at startup on the top layer.
+*/
+
+#define NOTIFY_BODY_SIZE        MAX_MESSAGE_SIZE
+#define NOTIFY_HEADER_SIZE      96
+#define NOTIFY_PAGE_SIZE        1024
+#define NOTIFY_MAX_LINES        320
+//! Lines wrapped per background layout step
+#define NOTIFY_LAYOUT_STEP      8
+#define NOTIFY_LAYOUT_MS        20
+
+void setupNotifyView();
+void notify_view_show(uint32_t id, const char *src, const char *title, const char *body);
+void notify_view_hide();
+void notify_view_report();
+
+#endif /*__NOTIFYVIEW_H */
@@ -0,0 +1,48 @@
+#ifndef __POOL_H
+#define __POOL_H
+
+// Build with -D POOL_SOAK_TEST=1 to create and delete the pooled GUI
+// helpers repeatedly at boot and print the pools and heap before/after.
+#ifndef POOL_SOAK_TEST
+#define POOL_SOAK_TEST 0
+#endif
+
+/*
+    Fixed slot pool. A full pool falls back to the heap so `new` never
+    fails; every fallback is counted and logged so the pool can be resized.
+*/
+class PoolBase
+{
+public:
+    PoolBase(const char *name, uint8_t *storage, size_t slotSize, uint8_t capacity);
+    void *alloc(size_t size);
+    void free(void *p);
+    static void report(const char *tag);
+private:
+    const char *_name;
+    uint8_t *_storage;
+    size_t _slotSize;
+    uint8_t _capacity;
+    uint32_t _freeMask;
+    uint8_t _used = 0;
+    uint8_t _peak = 0;
+    uint32_t _overflows = 0;
+    portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+    PoolBase *_next;
+    static PoolBase *_head;
+};
+
+template<typename T, uint8_t N>
+class ObjectPool : public PoolBase
+{
+    static_assert(N <= 32, "ObjectPool tracks slots in a 32 bit mask");
+public:
+    ObjectPool(const char *name) : PoolBase(name, _slots, SLOT, N) {}
+private:
+    enum { SLOT = (sizeof(T) + 3) & ~3 };
+    uint8_t _slots[N * SLOT] __attribute__((aligned(4)));
+};
+
+void pool_soak_test(uint32_t cycles);
+
+#endif /*__POOL_H */
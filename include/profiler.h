@@ -0,0 +1,34 @@
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+// Frame profiler around lv_task_handler(). Build with -D WATCH_PROFILER=0
+// for release, which compiles every hook below out.
+#ifndef WATCH_PROFILER
+#define WATCH_PROFILER          1
+#endif
+
+//! Frames slower than this are logged with the task that took longest
+#ifndef PROFILER_JANK_US
+#define PROFILER_JANK_US        (33 * 1000)
+#endif
+
+#define PROFILER_MAX_TASKS      16
+#define PROFILER_BUCKETS        10
+
+#if WATCH_PROFILER
+void setupProfiler();
+void profiler_frame_begin();
+void profiler_frame_end();
+void profiler_dump();
+void profiler_reset();
+#define PROFILER_FRAME_BEGIN()  profiler_frame_begin()
+#define PROFILER_FRAME_END()    profiler_frame_end()
+#else
+#define setupProfiler()
+#define profiler_dump()
+#define profiler_reset()
+#define PROFILER_FRAME_BEGIN()
+#define PROFILER_FRAME_END()
+#endif
+
+#endif /*__PROFILER_H */
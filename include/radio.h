@@ -0,0 +1,32 @@
+#ifndef __RADIO_H
+#define __RADIO_H
+
+/*
+    WiFi radio manager. The radio stays off until a client acquires it and
+    is switched off again once the last client has released it for
+    RADIO_IDLE_MS. While BLE is up as well the coexistence preference
+    follows whoever needs the air time.
+*/
+
+//! Keep the radio up this long after the last client is done
+#ifndef RADIO_IDLE_MS
+#define RADIO_IDLE_MS   30000
+#endif
+
+typedef enum {
+    RADIO_CLIENT_USER,      //! The WiFi switch or a connect from the keyboard
+    RADIO_CLIENT_SCAN,
+    RADIO_CLIENT_NTP,
+    RADIO_CLIENT_OTA,
+    RADIO_CLIENT_MAX,
+} radio_client_t;
+
+void radio_acquire(radio_client_t client);
+void radio_release(radio_client_t client);
+//! Switch off now regardless of clients, e.g. when the watch goes to sleep
+void radio_shutdown();
+void radio_poll();
+bool radio_on();
+void radio_report();
+
+#endif /*__RADIO_H */
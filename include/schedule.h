@@ -0,0 +1,55 @@
+#ifndef __SCHEDULE_H
+#define __SCHEDULE_H
+
+#include <stdint.h>
+
+/*
+    Alarms and calendar events from Gadgetbridge. They are kept sorted by
+    their next occurrence in a fixed array saved to NVS, and only the
+    nearest one is programmed into the PCF8563 alarm. Its interrupt is the
+    only thing that makes us look at the schedule, then the next event is
+    programmed. Nothing polls the time.
+
+    The PCF8563 matches day of month, hour and minute, so an event more
+    than a month out can wake us early, which just reprograms the alarm.
+*/
+
+#define SCHEDULE_MAX        16
+#define SCHEDULE_TITLE_SIZE 32
+
+typedef enum {
+    SCHEDULE_ALARM,
+    SCHEDULE_CALENDAR,
+} schedule_kind_t;
+
+typedef struct {
+    //! Next occurrence and end, system clock seconds
+    uint32_t time;
+    uint32_t end;
+    //! Calendar id from the phone and start in UTC, to redo time when the clock changes
+    uint32_t id;
+    uint32_t utc;
+    uint8_t kind;
+    //! Alarm days, bit 0 is Monday, 0 for a single alarm
+    uint8_t repeat;
+    uint8_t hour;
+    uint8_t minute;
+    char title[SCHEDULE_TITLE_SIZE];
+} schedule_event_t;
+
+void setupSchedule();
+//! Drop all alarms, the phone always sends the full list
+void schedule_clear_alarms();
+bool schedule_add_alarm(uint8_t hour, uint8_t minute, uint8_t repeat);
+bool schedule_add_calendar(uint32_t id, uint32_t startUtc, uint32_t duration, const char *title);
+void schedule_remove_calendar(uint32_t id);
+//! Save the changes and program the nearest event
+void schedule_commit();
+//! The RTC alarm fired
+void schedule_irq();
+//! The system clock was stepped, switched to UTC or the RTC rewritten: redo every
+//! occurrence for the new clock and program the RTC alarm again
+void schedule_clock_changed();
+void schedule_report();
+
+#endif /*__SCHEDULE_H */
@@ -0,0 +1,56 @@
+#ifndef __SCREEN_H
+#define __SCREEN_H
+
+//! LVGL heap that hidden, cached screens may hold before the least recently used is destroyed
+#ifndef SCREEN_CACHE_BUDGET
+#define SCREEN_CACHE_BUDGET     (12 * 1024)
+#endif
+
+#define SCREEN_MAX_CACHED       8
+#define SCREEN_STACK_DEPTH      6
+
+class ScreenStack
+{
+public:
+    typedef struct {
+        const char *name;
+        void (*create)();
+        void (*show)();
+        void (*hide)();
+        void (*destroy)();
+
+        //! Filled in by the stack
+        bool built;
+        bool pinned;
+        int arena;
+        uint32_t cost;
+        uint32_t lastUsed;
+        uint32_t createUs;
+        uint32_t hits;
+        uint32_t misses;
+    } screen_t;
+
+    ScreenStack();
+    static ScreenStack *getScreenStack();
+    void push(screen_t *screen);
+    void preload(screen_t *screen);
+    void pop();
+    void replace(screen_t *screen);
+    void clear();
+    void evict(screen_t *screen);
+    screen_t *top() const;
+    uint8_t depth() const;
+    void report();
+private:
+    void open(screen_t *screen);
+    void track(screen_t *screen);
+    bool onStack(const screen_t *screen) const;
+    void trim();
+    screen_t *_stack[SCREEN_STACK_DEPTH];
+    uint8_t _depth = 0;
+    screen_t *_cached[SCREEN_MAX_CACHED];
+    uint8_t _cachedCount = 0;
+    uint32_t _tick = 0;
+};
+
+#endif /*__SCREEN_H */
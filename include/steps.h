@@ -0,0 +1,39 @@
+#ifndef __STEPS_H
+#define __STEPS_H
+
+#include <stdint.h>
+
+/*
+    Step counting on the BMA423. The sensor counts steps itself and only
+    raises INT1 every STEPS_WATERMARK * 20 steps, so a sleeping watch wakes
+    a few times an hour instead of on every step. The count is shown while
+    the screen is on and only cached while it is off.
+*/
+
+//! Step counter interrupt every STEPS_WATERMARK * 20 steps, 10 bits
+#ifndef STEPS_WATERMARK
+#define STEPS_WATERMARK     10
+#endif
+
+//! Refresh the step count on screen this often while it is on
+#ifndef STEPS_POLL_MS
+#define STEPS_POLL_MS       2000
+#endif
+
+//! Read-modify-write one 16 bit word of the BMA423 feature config, at one of
+//! the BMA423_*_OFFSET word offsets from the library's bma423.h
+bool bma_feature_update(uint8_t offset, uint16_t mask, uint16_t value);
+//! Read one 16 bit word of the BMA423 feature config
+uint16_t bma_feature_read(uint8_t offset);
+
+void setupSteps();
+//! Handle a latched INT1, screenOn decides whether the count is shown
+void steps_irq(bool screenOn);
+//! Read the counter and show it, used when the screen comes back on
+void steps_publish();
+//! Read the counter without touching the screen
+uint32_t steps_read();
+uint32_t steps_count();
+void steps_report();
+
+#endif /*__STEPS_H */
@@ -0,0 +1,47 @@
+#ifndef __TIMEKEEPER_H
+#define __TIMEKEEPER_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+    Clock discipline. The system clock is kept corrected with a learned
+    drift rate instead of reloading it from the PCF8563 on every wake, and
+    the RTC is only rewritten once its own predicted error is too large.
+*/
+
+//! Read the RTC on wake at most this often to catch a lost system clock
+#ifndef TIMEKEEPER_RTC_CHECK_S
+#define TIMEKEEPER_RTC_CHECK_S      (6 * 3600)
+#endif
+
+//! Rewrite the RTC when its predicted drift since the last write passes this,
+//! on top of the up to 500 ms every write leaves, see lib/rtcdrift
+#ifndef TIMEKEEPER_RTC_MAX_ERROR_MS
+#define TIMEKEEPER_RTC_MAX_ERROR_MS 500
+#endif
+
+//! System clock and RTC disagreeing by more than this means the system clock is wrong
+#define TIMEKEEPER_STEP_MS          2000
+
+//! Assumed RTC crystal error until one has been measured
+#define TIMEKEEPER_RTC_PPM_DEFAULT  20.0f
+
+//! Uncertainty of a time reference from NTP and from the phone, which sends whole seconds
+#define TIMEKEEPER_NTP_RESOLUTION_MS    100
+#define TIMEKEEPER_PHONE_RESOLUTION_MS  1000
+
+//! Only learn a drift rate from a baseline long enough for this precision
+#define TIMEKEEPER_PPM_PRECISION    10.0f
+
+void timekeeper_begin();
+void timekeeper_wake();
+void timekeeper_reference(int64_t trueUs, uint32_t resolutionMs, bool updateRtc);
+void timekeeper_write_rtc();
+//! The phone's UTC offset, used while the clock still holds local time
+void timekeeper_set_zone_offset(int32_t seconds);
+//! Convert a UTC time from the phone to system clock seconds
+time_t timekeeper_from_utc(time_t utc);
+void timekeeper_report();
+
+#endif /*__TIMEKEEPER_H */
@@ -0,0 +1,14 @@
+#ifndef __TOUCH_H
+#define __TOUCH_H
+
+//! Sample period while a finger is down
+#ifndef TOUCH_SAMPLE_MS
+#define TOUCH_SAMPLE_MS     10
+#endif
+
+#define TOUCH_BUFFER_SIZE   16
+
+void setupTouch();
+void touch_report();
+
+#endif /*__TOUCH_H */
@@ -0,0 +1,41 @@
+#ifndef __WAKE_H
+#define __WAKE_H
+
+/*
+    Wake on wrist tilt or double tap. Both gestures are recognised by the
+    BMA423 feature engine, which does the debouncing: a tilt has to match
+    the raise-and-turn pattern and a double tap two taps inside its window,
+    at WAKE_TAP_SENSITIVITY. The ESP32 only sees the finished gesture on
+    INT1, shared with the step counter.
+*/
+
+#ifndef WAKE_TILT
+#define WAKE_TILT               1
+#endif
+#ifndef WAKE_DOUBLE_TAP
+#define WAKE_DOUBLE_TAP         1
+#endif
+//! 0 is the most sensitive, 7 the least
+#ifndef WAKE_TAP_SENSITIVITY
+#define WAKE_TAP_SENSITIVITY    4
+#endif
+
+//! A gesture wake put back to sleep within this, by the button or otherwise,
+//! was unwanted. A tilt to glance at the time needs no touch, so an untouched
+//! wake that is left to time out still counts as a good one.
+#ifndef WAKE_DISMISS_MS
+#define WAKE_DISMISS_MS         1000
+#endif
+//! Touches this soon after the screen came on are still part of the wake
+#define WAKE_INTERACT_MARGIN_MS 500
+
+void setupWake();
+//! From the INT1 ISR while asleep, timestamps the start of a possible wake
+void wake_mark();
+//! Read the latched status, true if a wake gesture is among the causes
+bool wake_classify();
+void wake_shown();
+void wake_sleeping();
+void wake_report();
+
+#endif /*__WAKE_H */
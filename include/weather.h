@@ -0,0 +1,44 @@
+#ifndef __WEATHER_H
+#define __WEATHER_H
+
+#include <stdint.h>
+
+/*
+    Latest Gadgetbridge weather report. It is kept in a fixed size record
+    that is also saved to NVS, so the clock face shows it straight after a
+    restart. Condition icons are drawn procedurally into small alpha maps
+    the first time they are needed and kept in an LRU cache. The clock
+    face complication only redraws when the text or icon it would show
+    changes.
+*/
+
+#define WEATHER_TEXT_SIZE   24
+#define WEATHER_ICON_SIZE   32
+#define WEATHER_ICON_SLOTS  3
+
+typedef struct {
+    //! Wall clock seconds of the report, 0 if there is none
+    uint32_t updated;
+    //! Degrees Celsius
+    int16_t temp;
+    int16_t hi;
+    int16_t lo;
+    uint8_t humidity;
+    uint8_t rain;
+    uint8_t uv;
+    //! OpenWeatherMap condition code
+    uint16_t code;
+    uint16_t wind;
+    uint16_t windDir;
+    char text[WEATHER_TEXT_SIZE];
+    char location[WEATHER_TEXT_SIZE];
+} weather_t;
+
+void setupWeather();
+//! Put the complication on the clock face
+void weather_create(lv_obj_t *parent);
+void weather_update(const weather_t *w);
+const weather_t *weather_get();
+void weather_report();
+
+#endif /*__WEATHER_H */
@@ -0,0 +1,39 @@
+#ifndef __WIFICACHE_H
+#define __WIFICACHE_H
+
+/*
+    WiFi connection cache. The BSSID, channel and IP lease of the last few
+    networks are kept in NVS so a reconnect can skip the channel scan and
+    DHCP. A cached attempt that fails to associate falls back to a normal
+    connect. A reused address may have been handed to someone else since,
+    which association does not show, so it is only accepted once the DNS
+    server (or the gateway) answers a query sent from it.
+*/
+
+#define WIFI_CACHE_ENTRIES  4
+
+//! Reuse a leased address without DHCP for this long after it was obtained
+#ifndef WIFI_CACHE_LEASE_S
+#define WIFI_CACHE_LEASE_S  (12 * 3600)
+#endif
+
+//! Wait this long for the DNS server to answer from a reused address
+#ifndef WIFI_CACHE_PROBE_MS
+#define WIFI_CACHE_PROBE_MS 800
+#endif
+
+void setupWifiCache();
+//! Connect to ssid, or to the most recently used network when ssid is NULL
+void wifi_connect(const char *ssid, const char *password);
+bool wifi_cache_known(const char *ssid);
+//! From the GOT_IP event, only flags the address for wifi_cache_poll()
+void wifi_cache_got_ip();
+//! From loop(), true once an address is confirmed. A reused one is first
+//! probed for up to WIFI_CACHE_PROBE_MS without blocking, a failed probe
+//! starts a full connect.
+bool wifi_cache_poll();
+void wifi_cache_disconnected(uint8_t reason);
+void wifi_cache_radio(bool on);
+void wifi_cache_report();
+
+#endif /*__WIFICACHE_H */
@@ -0,0 +1,34 @@
+#ifndef __WIFISCAN_H
+#define __WIFISCAN_H
+
+#include <stdint.h>
+
+/*
+    Scan results engine. Results are collapsed to one entry per SSID with
+    the strongest signal, known networks are sorted first, then by RSSI,
+    and the table is kept for a while so reopening the list is instant.
+*/
+
+#define WIFI_SCAN_MAX       16
+
+//! Reuse the last scan instead of scanning again within this window
+#ifndef WIFI_SCAN_CACHE_MS
+#define WIFI_SCAN_CACHE_MS  30000
+#endif
+
+typedef struct {
+    char ssid[33];
+    int8_t rssi;
+    uint8_t aps;
+    bool secure;
+    bool known;
+} wifi_scan_result_t;
+
+void wifi_scan_collect();
+bool wifi_scan_fresh();
+void wifi_scan_invalidate();
+int wifi_scan_count();
+const wifi_scan_result_t *wifi_scan_get(int i);
+void wifi_scan_report();
+
+#endif /*__WIFISCAN_H */
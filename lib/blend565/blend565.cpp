@@ -0,0 +1,100 @@
+/*
+    - fills store two pixels per 32 bit word
+    - fully opaque maps (menu icons, wallpaper) are a plain memcpy
+    - translucent maps expand each pixel to 0x07E0F81F form so all three
+      channels are mixed with one multiply, with the common opacities
+      (the LV_OPA_20 status bar, LV_OPA_50 overlays) fixed at compile time
+*/
+
+#include <string.h>
+#include "blend565.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#else
+#define IRAM_ATTR
+#endif
+
+template<bool SWAP>
+static inline uint16_t load565(uint16_t c)
+{
+    return SWAP ? __builtin_bswap16(c) : c;
+}
+
+// a5 is the 0..32 opacity of fg
+static inline uint16_t mix565(uint16_t fg, uint16_t bg, uint32_t a5)
+{
+    uint32_t f = (fg | ((uint32_t)fg << 16)) & 0x07E0F81F;
+    uint32_t b = (bg | ((uint32_t)bg << 16)) & 0x07E0F81F;
+    uint32_t r = ((((f - b) * a5) >> 5) + b) & 0x07E0F81F;
+    return (uint16_t)(r | (r >> 16));
+}
+
+template<bool SWAP, uint32_t A5>
+static void IRAM_ATTR blend_fixed(uint16_t *dest, const uint16_t *src, uint32_t length)
+{
+    uint32_t i = 0;
+    for (; i + 1 < length; i += 2) {
+        uint16_t d0 = mix565(load565<SWAP>(src[i]), load565<SWAP>(dest[i]), A5);
+        uint16_t d1 = mix565(load565<SWAP>(src[i + 1]), load565<SWAP>(dest[i + 1]), A5);
+        dest[i] = load565<SWAP>(d0);
+        dest[i + 1] = load565<SWAP>(d1);
+    }
+    if (i < length) {
+        dest[i] = load565<SWAP>(mix565(load565<SWAP>(src[i]), load565<SWAP>(dest[i]), A5));
+    }
+}
+
+template<bool SWAP>
+static void IRAM_ATTR blend_any(uint16_t *dest, const uint16_t *src, uint32_t length, uint32_t a5)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        dest[i] = load565<SWAP>(mix565(load565<SWAP>(src[i]), load565<SWAP>(dest[i]), a5));
+    }
+}
+
+void IRAM_ATTR blend565_fill(uint16_t *dest, uint32_t length, uint16_t color)
+{
+    if (length == 0) return;
+    if (((uintptr_t)dest & 2) != 0) {
+        *dest++ = color;
+        length--;
+    }
+    uint32_t word = color | ((uint32_t)color << 16);
+    uint32_t *d32 = (uint32_t *)dest;
+    uint32_t words = length >> 1;
+    for (uint32_t i = 0; i < words; i++) {
+        d32[i] = word;
+    }
+    if (length & 1) {
+        dest[length - 1] = color;
+    }
+}
+
+template<bool SWAP>
+void IRAM_ATTR blend565_map(uint16_t *dest, const uint16_t *src, uint32_t length, uint8_t opa)
+{
+    if (opa >= BLEND565_OPA_MAX) {
+        memcpy(dest, src, length * sizeof(uint16_t));
+        return;
+    }
+    if (opa <= BLEND565_OPA_MIN) return;
+
+    switch (opa) {
+    case BLEND565_OPA_20:
+        blend_fixed<SWAP, ((BLEND565_OPA_20 + 4) >> 3)>(dest, src, length);
+        break;
+    case BLEND565_OPA_50:
+        blend_fixed<SWAP, ((BLEND565_OPA_50 + 4) >> 3)>(dest, src, length);
+        break;
+    case BLEND565_OPA_70:
+        blend_fixed<SWAP, ((BLEND565_OPA_70 + 4) >> 3)>(dest, src, length);
+        break;
+    default:
+        blend_any<SWAP>(dest, src, length, (opa + 4) >> 3);
+        break;
+    }
+}
+
+template void blend565_map<false>(uint16_t *dest, const uint16_t *src, uint32_t length, uint8_t opa);
+template void blend565_map<true>(uint16_t *dest, const uint16_t *src, uint32_t length, uint8_t opa);
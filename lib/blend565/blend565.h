@@ -0,0 +1,26 @@
+#ifndef __BLEND565_H
+#define __BLEND565_H
+
+#include <stdint.h>
+
+/*
+    RGB565 fill/copy/blend kernels behind src/blend.cpp. They only work on
+    raw 16 bit pixels and need neither Arduino nor LVGL, so the same code
+    is timed on the host and on the watch by test/test_blend.
+
+    SWAP is LV_COLOR_16_SWAP: pixels are stored byte swapped for the
+    display. Opacity is LVGL's 0..255 lv_opa_t.
+*/
+
+//! LVGL's lv_opa_t values the kernels special case
+#define BLEND565_OPA_MIN    2
+#define BLEND565_OPA_20     51
+#define BLEND565_OPA_50     127
+#define BLEND565_OPA_70     178
+#define BLEND565_OPA_MAX    253
+
+void blend565_fill(uint16_t *dest, uint32_t length, uint16_t color);
+template<bool SWAP>
+void blend565_map(uint16_t *dest, const uint16_t *src, uint32_t length, uint8_t opa);
+
+#endif /*__BLEND565_H */
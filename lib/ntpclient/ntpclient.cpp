@@ -0,0 +1,299 @@
+#include <string.h>
+#include "ntpclient.h"
+
+//! Seconds between the NTP era (1900) and the Unix epoch
+#define NTP_UNIX_OFFSET     2208988800ULL
+
+static const char *const defaultServers[] = {NTP_SERVERS};
+
+static void put_timestamp(uint8_t *p, int64_t us)
+{
+    uint32_t sec = (uint32_t)(us / 1000000 + NTP_UNIX_OFFSET);
+    uint32_t frac = (uint32_t)(((uint64_t)(us % 1000000) << 32) / 1000000);
+    p[0] = sec >> 24; p[1] = sec >> 16; p[2] = sec >> 8; p[3] = sec;
+    p[4] = frac >> 24; p[5] = frac >> 16; p[6] = frac >> 8; p[7] = frac;
+}
+
+static int64_t get_timestamp(const uint8_t *p)
+{
+    uint32_t sec = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    uint32_t frac = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+    return ((int64_t)sec - (int64_t)NTP_UNIX_OFFSET) * 1000000 + (((uint64_t)frac * 1000000) >> 32);
+}
+
+NtpClient::NtpClient(const ntp_transport_t *transport)
+{
+    _transport = transport;
+    _servers = defaultServers;
+    _serverCount = sizeof(defaultServers) / sizeof(defaultServers[0]);
+    _port = NTP_PORT;
+}
+
+void NtpClient::setServers(const char *const *servers, uint8_t count, uint16_t port)
+{
+    _servers = servers;
+    _serverCount = count;
+    _port = port;
+    _server = 0;
+}
+
+void NtpClient::begin(ntp_done_cb cb)
+{
+    _cb = cb;
+    _attempts = 0;
+    _started = _transport->millis();
+    _state = NTP_RESOLVE;
+}
+
+void NtpClient::cancel()
+{
+    _transport->close();
+    _state = NTP_IDLE;
+    _cb = nullptr;
+}
+
+bool NtpClient::busy() const
+{
+    return _state != NTP_IDLE;
+}
+
+uint8_t NtpClient::attempts() const
+{
+    return _attempts;
+}
+
+const char *NtpClient::server() const
+{
+    return _servers[_server];
+}
+
+void NtpClient::buildRequest(uint8_t *buf, int64_t txUs)
+{
+    memset(buf, 0, NTP_PACKET_SIZE);
+    //! LI 0, version 4, mode 3 (client)
+    buf[0] = (4 << 3) | 3;
+    put_timestamp(buf + 40, txUs);
+}
+
+bool NtpClient::parseResponse(const uint8_t *buf, int len, int64_t t1, int64_t t4, int64_t *offsetUs, int64_t *delayUs)
+{
+    if (len < NTP_PACKET_SIZE) return false;
+    uint8_t mode = buf[0] & 0x07;
+    uint8_t leap = buf[0] >> 6;
+    uint8_t stratum = buf[1];
+    //! Must be a server reply to our request and not a kiss-o'-death
+    if (mode != 4 || stratum == 0 || stratum > 15 || leap == 3) return false;
+
+    uint8_t origin[8];
+    put_timestamp(origin, t1);
+    if (memcmp(origin, buf + 24, 8) != 0) return false;
+
+    int64_t t2 = get_timestamp(buf + 32);
+    int64_t t3 = get_timestamp(buf + 40);
+    *offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+    *delayUs = (t4 - t1) - (t3 - t2);
+    return true;
+}
+
+bool NtpClient::isKissOfDeath(const uint8_t *buf, int len, int64_t t1)
+{
+    if (len < NTP_PACKET_SIZE || (buf[0] & 0x07) != 4 || buf[1] != 0) return false;
+    //! Only when it answers our request, anyone can send one
+    uint8_t origin[8];
+    put_timestamp(origin, t1);
+    return memcmp(origin, buf + 24, 8) == 0;
+}
+
+void NtpClient::poll()
+{
+    uint32_t now = _transport->millis();
+    switch (_state) {
+    case NTP_RESOLVE:
+        switch (_transport->resolve(_servers[_server], &_ip)) {
+        case NTP_RESOLVE_OK:
+            _state = NTP_SEND;
+            break;
+        case NTP_RESOLVE_PENDING:
+            if (now - _started > NTP_TIMEOUT_MS) retry();
+            break;
+        default:
+            retry();
+            break;
+        }
+        break;
+    case NTP_SEND: {
+        uint8_t buf[NTP_PACKET_SIZE];
+        _t1 = _transport->now_us();
+        buildRequest(buf, _t1);
+        if (!_transport->send(_ip, _port, buf, sizeof(buf))) {
+            retry();
+            break;
+        }
+        _deadline = now + NTP_TIMEOUT_MS;
+        _state = NTP_WAIT;
+        break;
+    }
+    case NTP_WAIT: {
+        uint8_t buf[NTP_PACKET_SIZE];
+        int len = _transport->recv(buf, sizeof(buf));
+        if (len > 0) {
+            int64_t offset, delay;
+            if (parseResponse(buf, len, _t1, _transport->now_us(), &offset, &delay)) {
+                finish(true, offset);
+                break;
+            }
+            if (isKissOfDeath(buf, len, _t1)) {
+                //! The server wants us to stop, move on to the next one without waiting
+                retry();
+                break;
+            }
+        }
+        if ((int32_t)(now - _deadline) >= 0) retry();
+        break;
+    }
+    case NTP_BACKOFF:
+        if ((int32_t)(now - _deadline) >= 0) {
+            _started = now;
+            _state = NTP_RESOLVE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void NtpClient::retry()
+{
+    _transport->close();
+    if (++_attempts >= NTP_MAX_ATTEMPTS) {
+        finish(false, 0);
+        return;
+    }
+    uint32_t backoff = NTP_BACKOFF_MS << (_attempts - 1);
+    if (backoff > NTP_BACKOFF_MAX_MS) backoff = NTP_BACKOFF_MAX_MS;
+    _deadline = _transport->millis() + backoff;
+    _server = (_server + 1) % _serverCount;
+    _state = NTP_BACKOFF;
+}
+
+void NtpClient::finish(bool ok, int64_t offsetUs)
+{
+    _transport->close();
+    _state = NTP_IDLE;
+    ntp_done_cb cb = _cb;
+    _cb = nullptr;
+    if (cb != nullptr) {
+        cb(ok, offsetUs);
+    }
+}
+
+/*****************************************************************
+ *
+ *          ! Arduino transport
+ *
+ */
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <sys/time.h>
+#include "lwip/dns.h"
+
+static WiFiUDP udp;
+static bool udpOpen = false;
+static const char *dnsHost = nullptr;
+static volatile ntp_resolve_t dnsState = NTP_RESOLVE_FAIL;
+static volatile uint32_t dnsIp = 0;
+
+static void dns_found(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    if (ipaddr != nullptr) {
+        dnsIp = ipaddr->u_addr.ip4.addr;
+        dnsState = NTP_RESOLVE_OK;
+    } else {
+        dnsState = NTP_RESOLVE_FAIL;
+    }
+}
+
+static ntp_resolve_t arduino_resolve(const char *host, uint32_t *ip)
+{
+    IPAddress addr;
+    if (addr.fromString(host)) {
+        *ip = (uint32_t)addr;
+        return NTP_RESOLVE_OK;
+    }
+    if (dnsHost != host) {
+        ip_addr_t cached;
+        dnsHost = host;
+        dnsState = NTP_RESOLVE_PENDING;
+        err_t err = dns_gethostbyname(host, &cached, dns_found, nullptr);
+        if (err == ERR_OK) {
+            dnsIp = cached.u_addr.ip4.addr;
+            dnsState = NTP_RESOLVE_OK;
+        } else if (err != ERR_INPROGRESS) {
+            dnsState = NTP_RESOLVE_FAIL;
+        }
+    }
+    if (dnsState != NTP_RESOLVE_PENDING) {
+        //! Look the name up again next time, the address may change
+        dnsHost = nullptr;
+    }
+    *ip = dnsIp;
+    return dnsState;
+}
+
+static bool arduino_send(uint32_t ip, uint16_t port, const uint8_t *buf, int len)
+{
+    if (!udpOpen) {
+        udpOpen = udp.begin(0);
+        if (!udpOpen) return false;
+    }
+    if (!udp.beginPacket(IPAddress(ip), port)) return false;
+    udp.write(buf, len);
+    return udp.endPacket();
+}
+
+static int arduino_recv(uint8_t *buf, int len)
+{
+    if (!udpOpen || udp.parsePacket() <= 0) return 0;
+    return udp.read(buf, len);
+}
+
+static void arduino_close()
+{
+    if (udpOpen) {
+        udp.stop();
+        udpOpen = false;
+    }
+}
+
+static int64_t arduino_now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint32_t arduino_millis()
+{
+    return millis();
+}
+
+const ntp_transport_t ntp_arduino_transport = {
+    arduino_resolve,
+    arduino_send,
+    arduino_recv,
+    arduino_close,
+    arduino_now_us,
+    arduino_millis,
+};
+
+static NtpClient ntpClient(&ntp_arduino_transport);
+
+NtpClient *NtpClient::getNtpClient()
+{
+    return &ntpClient;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __NTPCLIENT_H
+#define __NTPCLIENT_H
+
+#include <stdint.h>
+
+/*
+    Non-blocking SNTP client. poll() advances a small state machine
+    (resolve, send, wait, back off) and never waits on the network, so it
+    can run from an lv_task. All socket and clock access goes through an
+    ntp_transport_t, which lets the state machine run on the host against
+    a local UDP stand-in server (test/test_ntp); the watch uses
+    ntp_arduino_transport.
+*/
+
+#ifndef NTP_SERVERS
+#define NTP_SERVERS         "pool.ntp.org", "time.google.com", "time.cloudflare.com"
+#endif
+#ifndef NTP_PORT
+#define NTP_PORT            123
+#endif
+#ifndef NTP_TIMEOUT_MS
+#define NTP_TIMEOUT_MS      2000
+#endif
+#ifndef NTP_MAX_ATTEMPTS
+#define NTP_MAX_ATTEMPTS    6
+#endif
+#define NTP_BACKOFF_MS      500
+#define NTP_BACKOFF_MAX_MS  8000
+#define NTP_PACKET_SIZE     48
+
+typedef enum {
+    NTP_RESOLVE_OK,
+    NTP_RESOLVE_PENDING,
+    NTP_RESOLVE_FAIL,
+} ntp_resolve_t;
+
+typedef struct {
+    ntp_resolve_t (*resolve)(const char *host, uint32_t *ip);
+    bool (*send)(uint32_t ip, uint16_t port, const uint8_t *buf, int len);
+    //! Returns the bytes of a pending datagram, 0 if there is none
+    int (*recv)(uint8_t *buf, int len);
+    void (*close)();
+    //! Wall clock in microseconds since 1970
+    int64_t (*now_us)();
+    uint32_t (*millis)();
+} ntp_transport_t;
+
+class NtpClient
+{
+public:
+    typedef void (*ntp_done_cb)(bool ok, int64_t offsetUs);
+    NtpClient(const ntp_transport_t *transport);
+    static NtpClient *getNtpClient();
+    void setServers(const char *const *servers, uint8_t count, uint16_t port = NTP_PORT);
+    void begin(ntp_done_cb cb);
+    void poll();
+    void cancel();
+    bool busy() const;
+    uint8_t attempts() const;
+    const char *server() const;
+    static void buildRequest(uint8_t *buf, int64_t txUs);
+    static bool parseResponse(const uint8_t *buf, int len, int64_t t1, int64_t t4, int64_t *offsetUs, int64_t *delayUs);
+    //! A kiss-o'-death reply to the request sent at t1
+    static bool isKissOfDeath(const uint8_t *buf, int len, int64_t t1);
+private:
+    typedef enum {
+        NTP_IDLE,
+        NTP_RESOLVE,
+        NTP_SEND,
+        NTP_WAIT,
+        NTP_BACKOFF,
+    } ntp_state_t;
+    void retry();
+    void finish(bool ok, int64_t offsetUs);
+    const ntp_transport_t *_transport;
+    const char *const *_servers;
+    uint8_t _serverCount;
+    uint16_t _port;
+    ntp_state_t _state = NTP_IDLE;
+    uint8_t _server = 0;
+    uint8_t _attempts = 0;
+    uint32_t _ip = 0;
+    uint32_t _started = 0;
+    uint32_t _deadline = 0;
+    int64_t _t1 = 0;
+    ntp_done_cb _cb = nullptr;
+};
+
+#ifdef ARDUINO
+extern const ntp_transport_t ntp_arduino_transport;
+#endif
+
+#endif /*__NTPCLIENT_H */
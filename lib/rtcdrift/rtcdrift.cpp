@@ -0,0 +1,13 @@
+#include <math.h>
+#include "rtcdrift.h"
+
+uint32_t rtc_drift_ms(float ppm, float elapsedS)
+{
+    if (elapsedS <= 0) return 0;
+    return (uint32_t)(fabsf(ppm) * elapsedS / 1000.0f);
+}
+
+bool rtc_write_due(float ppm, float elapsedS, uint32_t maxMs)
+{
+    return rtc_drift_ms(ppm, elapsedS) > maxMs;
+}
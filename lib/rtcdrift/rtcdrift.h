@@ -0,0 +1,20 @@
+#ifndef __RTCDRIFT_H
+#define __RTCDRIFT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+    When a time reference is worth writing to the PCF8563. Only the drift
+    the RTC has built up since its last write counts: the RTC holds whole
+    seconds, so every write, this one included, leaves up to 500 ms of
+    rounding that rewriting cannot remove. Kept apart from timekeeper.cpp
+    so test/test_rtcdrift can replay a day of phone syncs on the host.
+*/
+
+//! Drift in ms built up at ppm over elapsedS seconds, either direction
+uint32_t rtc_drift_ms(float ppm, float elapsedS);
+//! A reference that did not step the clock only needs writing past maxMs of drift
+bool rtc_write_due(float ppm, float elapsedS, uint32_t maxMs);
+
+#endif /*__RTCDRIFT_H */
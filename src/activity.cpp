@@ -0,0 +1,382 @@
+#include "config.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <Preferences.h>
+#include <time.h>
+#include "ble.h"
+#include "bletx.h"
+#include "steps.h"
+#include "activity.h"
+
+#define ACTIVITY_MAGIC          0x41435431  // "ACT1"
+//! Don't record before the clock has been set to something plausible (2020)
+#define ACTIVITY_VALID_TIME     1577836800UL
+//! Give the phone time to finish pairing before pushing history
+#define ACTIVITY_SYNC_DELAY_MS  5000
+//! TX slots left free during a sync for replies to the user
+#define ACTIVITY_TX_RESERVE     2
+//! Retry a failed flush before a timeline restart this often, and give up after this many tries
+#define ACTIVITY_RETRY_MS       60000
+#define ACTIVITY_RETRIES        10
+
+#define ACTIVITY_FILE_OLD       "/act0.bin"
+#define ACTIVITY_FILE_NEW       "/act1.bin"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t head;
+    uint16_t count;
+    //! Open bin, the ring holds the count bins right before it
+    uint32_t binStart;
+    uint32_t binCounter;
+    uint32_t movement;
+    uint16_t samples;
+    int16_t last[3];
+    uint16_t bins[ACTIVITY_RTC_BINS];
+} activity_ring_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t start;
+    uint16_t count;
+    uint16_t reserved;
+    uint16_t bins[ACTIVITY_BLOCK_BINS];
+} activity_block_t;
+
+//! Not cleared by a restart or crash, only by power loss
+RTC_NOINIT_ATTR static activity_ring_t ring;
+
+static activity_block_t cache;
+static bool cacheValid = false;
+static uint32_t lastSampleMs = 0;
+//! Set by the boot task once SPIFFS is mounted
+static volatile bool storageReady = false;
+static uint32_t restartFailMs = 0;
+static uint32_t restartFails = 0;
+
+static volatile uint32_t syncRequest = 0;
+static volatile bool syncRequested = false;
+static uint32_t syncRequestMs = 0;
+static bool syncing = false;
+static uint32_t syncT = 0;
+//! Records before this have left the TX queue
+static uint32_t sentT = 0;
+static uint32_t syncSent = 0;
+static uint32_t syncStartMs = 0;
+static uint32_t lastSyncMs = 0;
+static uint32_t unsaved = 0;
+
+static uint32_t blocksWritten = 0;
+static uint32_t writeFailures = 0;
+static uint32_t binsDropped = 0;
+static uint32_t recordsSent = 0;
+static uint32_t lastSyncDurationMs = 0;
+
+static uint16_t encode(uint32_t steps, uint32_t movement, uint16_t samples)
+{
+    uint32_t intensity = samples ? movement / samples / ACTIVITY_MOVEMENT_SCALE : 0;
+    if (steps > 0x0FFF) steps = 0x0FFF;
+    if (intensity > 0x0F) intensity = 0x0F;
+    return (steps << 4) | intensity;
+}
+
+static uint32_t ring_start()
+{
+    return ring.binStart - ring.count * ACTIVITY_BIN_S;
+}
+
+static uint16_t ring_at(uint16_t i)
+{
+    return ring.bins[(ring.head + i) % ACTIVITY_RTC_BINS];
+}
+
+//! Append the oldest n bins of the ring to the history as one block, at most a block's worth
+static bool flush(uint16_t n)
+{
+    if (n > ACTIVITY_BLOCK_BINS) n = ACTIVITY_BLOCK_BINS;
+    if (n == 0) return true;
+    activity_block_t *block = &cache;
+    cacheValid = false;
+    memset(block, 0, sizeof(*block));
+    block->magic = ACTIVITY_MAGIC;
+    block->start = ring_start();
+    block->count = n;
+    for (uint16_t i = 0; i < n; i++) {
+        block->bins[i] = ring_at(i);
+    }
+
+    File f = SPIFFS.open(ACTIVITY_FILE_NEW, FILE_APPEND);
+    if (!f) {
+        writeFailures++;
+        return false;
+    }
+    if (f.size() >= ACTIVITY_FILE_BLOCKS * sizeof(activity_block_t)) {
+        f.close();
+        SPIFFS.remove(ACTIVITY_FILE_OLD);
+        SPIFFS.rename(ACTIVITY_FILE_NEW, ACTIVITY_FILE_OLD);
+        f = SPIFFS.open(ACTIVITY_FILE_NEW, FILE_APPEND);
+    }
+    bool ok = f && f.write((const uint8_t *)block, sizeof(*block)) == sizeof(*block);
+    f.close();
+    if (!ok) {
+        writeFailures++;
+        return false;
+    }
+    blocksWritten++;
+    ring.head = (ring.head + n) % ACTIVITY_RTC_BINS;
+    ring.count -= n;
+    return true;
+}
+
+static void push(uint16_t bin)
+{
+    if (ring.count == ACTIVITY_RTC_BINS) {
+        //! Flash has been failing for a while, lose the oldest bin
+        ring.head = (ring.head + 1) % ACTIVITY_RTC_BINS;
+        ring.count--;
+        binsDropped++;
+    }
+    ring.bins[(ring.head + ring.count) % ACTIVITY_RTC_BINS] = bin;
+    ring.count++;
+    if (ring.count >= ACTIVITY_BLOCK_BINS) {
+        flush(ACTIVITY_BLOCK_BINS);
+    }
+}
+
+//! Write out the whole ring, a block at a time. Only what was written leaves the ring.
+static bool flush_all()
+{
+    while (ring.count) {
+        if (!flush(ring.count)) return false;
+    }
+    return true;
+}
+
+static bool restart(uint32_t now)
+{
+    //! Everything in the ring must stay contiguous with the open bin, so it goes to flash first
+    if (!flush_all()) {
+        if (++restartFails < ACTIVITY_RETRIES) {
+            restartFailMs = millis();
+            return false;
+        }
+        Serial.printf("Activity: history not writable, dropping %u bins\n", ring.count);
+        binsDropped += ring.count;
+        ring.head = (ring.head + ring.count) % ACTIVITY_RTC_BINS;
+        ring.count = 0;
+    }
+    restartFails = 0;
+    ring.binStart = now - now % ACTIVITY_BIN_S;
+    ring.binCounter = steps_read();
+    ring.movement = 0;
+    ring.samples = 0;
+    return true;
+}
+
+static void close_bin()
+{
+    uint32_t counter = steps_read();
+    //! The BMA423 counter starts over after a power loss of the sensor
+    uint32_t steps = counter >= ring.binCounter ? counter - ring.binCounter : counter;
+    push(encode(steps, ring.movement, ring.samples));
+    ring.binStart += ACTIVITY_BIN_S;
+    ring.binCounter = counter;
+    ring.movement = 0;
+    ring.samples = 0;
+}
+
+static void sample()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    Accel acc;
+    if (!ttgo->bma->getAccel(acc)) return;
+    if (ring.samples || ring.movement) {
+        ring.movement += abs(acc.x - ring.last[0]) + abs(acc.y - ring.last[1]) + abs(acc.z - ring.last[2]);
+    }
+    ring.last[0] = acc.x;
+    ring.last[1] = acc.y;
+    ring.last[2] = acc.z;
+    ring.samples++;
+}
+
+//! Find the bin starting at t, or the start of the next stored bin in *next
+static bool get_bin(uint32_t t, uint16_t *bin, uint32_t *next)
+{
+    *next = ring.binStart;
+    if (t >= ring.binStart) return false;
+
+    uint32_t rs = ring_start();
+    if (t >= rs) {
+        *bin = ring_at((t - rs) / ACTIVITY_BIN_S);
+        return true;
+    }
+    if (ring.count) *next = rs;
+
+    if (cacheValid && t >= cache.start && t < cache.start + cache.count * ACTIVITY_BIN_S) {
+        *bin = cache.bins[(t - cache.start) / ACTIVITY_BIN_S];
+        return true;
+    }
+
+    static const char *const files[] = {ACTIVITY_FILE_OLD, ACTIVITY_FILE_NEW};
+    for (int i = 0; i < 2; i++) {
+        File f = SPIFFS.open(files[i], FILE_READ);
+        if (!f) continue;
+        activity_block_t header;
+        size_t pos = 0;
+        while (f.seek(pos) && f.read((uint8_t *)&header, 12) == 12) {
+            if (header.magic == ACTIVITY_MAGIC) {
+                uint32_t end = header.start + header.count * ACTIVITY_BIN_S;
+                if (t >= header.start && t < end) {
+                    f.seek(pos);
+                    cacheValid = f.read((uint8_t *)&cache, sizeof(cache)) == sizeof(cache);
+                    f.close();
+                    if (!cacheValid) return false;
+                    *bin = cache.bins[(t - cache.start) / ACTIVITY_BIN_S];
+                    return true;
+                }
+                if (header.start > t && header.start < *next) {
+                    *next = header.start;
+                }
+            }
+            pos += sizeof(activity_block_t);
+        }
+        f.close();
+    }
+    return false;
+}
+
+static void save_cursor(uint32_t t)
+{
+    Preferences prefs;
+    prefs.begin("activity", false);
+    prefs.putUInt("cursor", t);
+    prefs.end();
+    unsaved = 0;
+}
+
+static void sync_step()
+{
+    if (!ble_connected()) {
+        //! Resume from the saved cursor on the next connection
+        syncing = false;
+        return;
+    }
+
+    //! An empty queue means everything queued so far has reached the phone
+    if (tx_depth() == 0) {
+        sentT = syncT;
+        if (unsaved >= ACTIVITY_CURSOR_SAVE) save_cursor(sentT);
+    }
+
+    //! Records go out through the TX queue as whole lines, so they never
+    //! interleave with other messages and a queued line is never taken back
+    while (TX_SLOTS - tx_depth() > ACTIVITY_TX_RESERVE) {
+        uint16_t bin;
+        uint32_t next;
+        if (!get_bin(syncT, &bin, &next)) {
+            if (next <= syncT) break;
+            syncT = next;
+            continue;
+        }
+        if ((bin >> 4) == 0 && (bin & 0x0F) == 0) {
+            syncT += ACTIVITY_BIN_S;
+            continue;
+        }
+        if (!tx_send("{\"t\":\"act\",\"ts\":%u000,\"stp\":%u,\"mov\":%u,\"rt\":0}",
+                     syncT, bin >> 4, (bin & 0x0F) * 16)) {
+            return;
+        }
+        syncT += ACTIVITY_BIN_S;
+        syncSent++;
+        unsaved++;
+    }
+
+    uint16_t bin;
+    uint32_t next;
+    if (get_bin(syncT, &bin, &next) || next > syncT) return;
+
+    //! Caught up with the open bin, end once the last record is out
+    if (tx_depth() != 0) return;
+    if (!tx_send("{\"t\":\"actfetch\",\"state\":\"end\",\"count\":%u}", syncSent)) return;
+    recordsSent += syncSent;
+    lastSyncDurationMs = millis() - syncStartMs;
+    Serial.printf("Activity: synced %u records in %u ms\n", syncSent, lastSyncDurationMs);
+    save_cursor(syncT);
+    syncing = false;
+}
+
+static bool sync_begin(uint32_t fromTime)
+{
+    if (!tx_send("{\"t\":\"actfetch\",\"state\":\"start\"}")) return false;
+    if (fromTime == 0) {
+        Preferences prefs;
+        prefs.begin("activity", true);
+        fromTime = prefs.getUInt("cursor", 0);
+        prefs.end();
+    }
+    syncT = sentT = fromTime - fromTime % ACTIVITY_BIN_S;
+    syncSent = 0;
+    unsaved = 0;
+    syncStartMs = millis();
+    syncing = true;
+    return true;
+}
+
+void setupActivity()
+{
+    if (ring.magic != ACTIVITY_MAGIC || ring.count > ACTIVITY_RTC_BINS || ring.head >= ACTIVITY_RTC_BINS) {
+        memset(&ring, 0, sizeof(ring));
+        ring.magic = ACTIVITY_MAGIC;
+    }
+}
+
+void activity_storage_ready()
+{
+    storageReady = true;
+}
+
+void activity_poll()
+{
+    uint32_t now = (uint32_t)time(nullptr);
+    if (!storageReady || now < ACTIVITY_VALID_TIME || ring.magic != ACTIVITY_MAGIC) return;
+
+    if (ring.binStart == 0 || now < ring.binStart ||
+            now - ring.binStart >= ACTIVITY_RTC_BINS * ACTIVITY_BIN_S) {
+        //! First bin, or the clock was set far enough to break the timeline
+        if (restartFails && millis() - restartFailMs < ACTIVITY_RETRY_MS) return;
+        if (!restart(now)) return;
+    }
+    while (now - ring.binStart >= ACTIVITY_BIN_S) {
+        close_bin();
+    }
+
+    uint32_t ms = millis();
+    if (ms - lastSampleMs >= ACTIVITY_SAMPLE_MS) {
+        lastSampleMs = ms;
+        sample();
+    }
+
+    if (syncRequested && ms - syncRequestMs >= ACTIVITY_SYNC_DELAY_MS && ble_connected()) {
+        syncRequested = !sync_begin(syncRequest);
+    }
+    if (syncing && ms - lastSyncMs >= ACTIVITY_SYNC_PERIOD_MS) {
+        lastSyncMs = ms;
+        sync_step();
+    }
+}
+
+void activity_sync(uint32_t fromTime)
+{
+    //! Called from the BLE task, the sync itself runs from loop()
+    syncRequest = fromTime;
+    syncRequestMs = millis();
+    syncRequested = true;
+}
+
+void activity_report()
+{
+    Serial.printf("Activity: %u bins in RTC memory from %u, open bin %u\n", ring.count, ring_start(), ring.binStart);
+    Serial.printf("  %u blocks written, %u write failures, %u bins dropped%s\n", blocksWritten, writeFailures, binsDropped,
+                  storageReady ? "" : ", storage not mounted");
+    Serial.printf("  %u records sent, last sync %u ms%s\n", recordsSent, lastSyncDurationMs, syncing ? ", syncing" : "");
+}
@@ -0,0 +1,97 @@
+#include "config.h"
+#include <Arduino.h>
+#include "esp_partition.h"
+#include "assets.h"
+
+typedef struct {
+    char magic[4];
+    uint32_t count;
+    uint32_t size;
+    uint32_t reserved;
+} asset_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t header;
+    char name[ASSET_NAME_SIZE];
+} asset_entry_t;
+
+static const uint8_t *base = nullptr;
+static const asset_entry_t *entries = nullptr;
+static spi_flash_mmap_handle_t mapping;
+static uint32_t count = 0;
+static uint32_t mappedBytes = 0;
+//! Built once at startup, LVGL keeps pointers to them
+static lv_img_dsc_t dscs[ASSET_MAX];
+
+static uint32_t mapUs = 0;
+static uint32_t lookups = 0;
+static uint32_t missing = 0;
+
+void setupAssets()
+{
+    uint32_t start = micros();
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  (esp_partition_subtype_t)ASSET_PARTITION_SUBTYPE, ASSET_PARTITION_LABEL);
+    if (part == nullptr) {
+        Serial.println("Assets: no assets partition, using fallbacks");
+        return;
+    }
+
+    asset_header_t header;
+    if (esp_partition_read(part, 0, &header, sizeof(header)) != ESP_OK || memcmp(header.magic, "WAS1", 4) ||
+            header.size > part->size || header.count * sizeof(asset_entry_t) + sizeof(header) > header.size) {
+        Serial.println("Assets: partition is empty or not an asset image, flash it with `pio run -t uploadassets`");
+        return;
+    }
+
+    //! One mapping for the whole image, the data cache does the rest
+    const void *ptr;
+    if (esp_partition_mmap(part, 0, header.size, SPI_FLASH_MMAP_DATA, &ptr, &mapping) != ESP_OK) {
+        Serial.println("Assets: mmap failed");
+        return;
+    }
+    base = (const uint8_t *)ptr;
+    entries = (const asset_entry_t *)(base + sizeof(header));
+    mappedBytes = header.size;
+    count = header.count > ASSET_MAX ? ASSET_MAX : header.count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(&dscs[i].header, &entries[i].header, sizeof(dscs[i].header));
+        dscs[i].data_size = entries[i].size;
+        dscs[i].data = base + entries[i].offset;
+    }
+    mapUs = micros() - start;
+    Serial.printf("Assets: %u assets, %u bytes mapped in %u us\n", count, mappedBytes, mapUs);
+}
+
+const lv_img_dsc_t *asset_img(uint32_t id)
+{
+    lookups++;
+    int lo = 0, hi = (int)count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (entries[mid].id == id) return &dscs[mid];
+        if (entries[mid].id < id) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    missing++;
+    return nullptr;
+}
+
+const void *asset_src(uint32_t id, const void *fallback)
+{
+    const lv_img_dsc_t *img = asset_img(id);
+    return img != nullptr ? img : fallback;
+}
+
+void assets_report()
+{
+    Serial.printf("Assets: %u assets, %u bytes mapped in %u us, %u lookups, %u missing\n",
+                  count, mappedBytes, mapUs, lookups, missing);
+    for (uint32_t i = 0; i < count; i++) {
+        Serial.printf("  %-24.24s %3ux%-3u %7u bytes\n", entries[i].name, dscs[i].header.w, dscs[i].header.h, entries[i].size);
+    }
+}
@@ -18,6 +18,9 @@
 #include <time.h>
 #include "gui.h"
 #include "gadgetbridge.h"
+#include "timekeeper.h"
+#include "activity.h"
+#include "blerx.h"
 
 #include <BLEDevice.h>
 #include <BLEServer.h>
@@ -35,16 +38,24 @@ static MBox *mbox = nullptr;
 
 BLEServer *pServer = NULL;
 BLECharacteristic *pTxCharacteristic;
+static BLE2902 *pTxCccd = nullptr;
 uint8_t txValue = 0;
 bool bleConnected = false;
 bool bleEnabled = false;
 bool blePairing = false;
 bool restoreMenubars = true;
 
-#define MAX_MESSAGE_SIZE 512
 String message;
 
-void processMessage();
+//! ATT MTU negotiated with the phone, 23 until it asks for more
+static uint16_t bleMtu = 23;
+//! The controller has run out of buffers for outgoing packets
+static volatile bool bleCongested = false;
+
+//! One notify at a time, its result comes back through TxCallbacks
+static SemaphoreHandle_t txLock = NULL;
+static BLECharacteristicCallbacks::Status txStatus;
+
 void destroyMBox();
 
 class MySecurity : public BLESecurityCallbacks {
@@ -114,6 +125,7 @@ class MyServerCallbacks : public BLEServerCallbacks
     {
         Serial.println("BLE Connected");
         bleConnected = true;
+        activity_sync(0);
         StatusBar *statusBar = StatusBar::getStatusBar();
         statusBar->show(LV_STATUS_BAR_BLUETOOTH);
     };
@@ -122,6 +134,8 @@ class MyServerCallbacks : public BLEServerCallbacks
     {
         Serial.println("BLE Disconnected");
         bleConnected = false;
+        bleCongested = false;
+        bleMtu = 23;
         StatusBar *statusBar = StatusBar::getStatusBar();
         statusBar->hidden(LV_STATUS_BAR_BLUETOOTH);
 
@@ -152,8 +166,8 @@ class MyCallbacks : public BLECharacteristicCallbacks
                         Serial.println("BLE Error: Message too long");
                         return;
                     }
-                    message[message.length()] = 0;
-                    processMessage();
+                    //! Handled later from loop(), most urgent first
+                    rx_push(message.c_str(), message.length());
                     message.clear();
                 } else {
                     message += rxValue[i];
@@ -168,32 +182,82 @@ class MyCallbacks : public BLECharacteristicCallbacks
     }
 };
 
-void processMessage() {
+void ble_process_message(char *msg, size_t len) {
     // 6 characters: GB({})
-    if (message.startsWith("GB(")) {
-        Serial.printf("BLE GB JSON: %s\n", message.substring(3, message.length()-1).c_str());
-        process_gadgetbridge_json(message.substring(3, message.length()-1).c_str());
-    } else if (message.startsWith("setTime(")) {
-        time_t time = message.substring(8).toInt();
-        int tz_str_offset = message.indexOf("E.setTimeZone(");
-        int tz = message.substring(tz_str_offset+14).toInt();
+    if (len >= 4 && !strncmp(msg, "GB(", 3)) {
+        msg[len-1] = 0;
+        Serial.printf("BLE GB JSON: %s\n", msg + 3);
+        process_gadgetbridge_json(msg + 3);
+    } else if (!strncmp(msg, "setTime(", 8)) {
+        time_t time = strtol(msg + 8, NULL, 10);
+        const char *tz_str = strstr(msg, "E.setTimeZone(");
+        int tz = tz_str != nullptr ? atoi(tz_str + 14) : 0;
+
+        //! The clock holds local time until an NTP sync has set a time zone
+        timekeeper_set_zone_offset(tz * 3600);
+        time = timekeeper_from_utc(time);
 
         struct tm timeinfo;
-        localtime_r(&time, &timeinfo);
-        Serial.printf("BLE set time %ld %d: %d-%d-%d/%d:%d:%d\n", time, tz, timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, (timeinfo.tm_hour + 24 + tz) % 24, timeinfo.tm_min, timeinfo.tm_sec);
+        gmtime_r(&time, &timeinfo);
+        Serial.printf("BLE set time %ld %d: %d-%d-%d/%d:%d:%d\n", time, tz, timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
 
-        TTGOClass *ttgo = TTGOClass::getWatch();
-        ttgo->rtc->setDateTime(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, (timeinfo.tm_hour + 24 + tz) % 24, timeinfo.tm_min, timeinfo.tm_sec);
-        ttgo->rtc->syncToSystem();
+        timekeeper_reference((int64_t)time * 1000000, TIMEKEEPER_PHONE_RESOLUTION_MS, true);
     } else {
-        Serial.printf("BLE other data: %s\n", message.c_str());
+        Serial.printf("BLE other data: %s\n", msg);
     }
 }
 
-void setupBle()
+class TxCallbacks : public BLECharacteristicCallbacks
 {
-    bleEnabled = true;
+    //! Called from inside notify() with the result of handing the packet to the stack
+    void onStatus(BLECharacteristic *pCharacteristic, Status s, uint32_t code)
+    {
+        txStatus = s;
+    }
+};
 
+static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
+{
+    if (event == ESP_GATTS_MTU_EVT) {
+        bleMtu = param->mtu.mtu;
+        Serial.printf("BLE MTU %u\n", bleMtu);
+    } else if (event == ESP_GATTS_CONGEST_EVT) {
+        bleCongested = param->congest.congested;
+    }
+}
+
+bool ble_connected()
+{
+    //! Nothing arrives before the phone has subscribed to the TX characteristic
+    return bleConnected && pTxCccd != nullptr && pTxCccd->getNotifications();
+}
+
+uint16_t ble_payload_size()
+{
+    //! 3 bytes of every packet are the ATT header
+    return bleMtu - 3;
+}
+
+ble_tx_t ble_notify_packet(const uint8_t *data, size_t len, TickType_t wait)
+{
+    if (!ble_connected()) return BLE_TX_DISCONNECTED;
+    if (bleCongested) return BLE_TX_CONGESTED;
+    if (xSemaphoreTake(txLock, wait) != pdTRUE) return BLE_TX_BUSY;
+
+    txStatus = BLECharacteristicCallbacks::Status::ERROR_GATT;
+    pTxCharacteristic->setValue((uint8_t *)data, len);
+    pTxCharacteristic->notify();
+    BLECharacteristicCallbacks::Status s = txStatus;
+    xSemaphoreGive(txLock);
+
+    if (s == BLECharacteristicCallbacks::Status::SUCCESS_NOTIFY) return BLE_TX_OK;
+    if (!ble_connected()) return BLE_TX_DISCONNECTED;
+    //! The stack refused the packet, almost always for lack of buffers
+    return BLE_TX_CONGESTED;
+}
+
+void setupBle()
+{
     // Create the BLE Device
     // Name needs to match filter in Gadgetbridge's banglejs getSupportedType() function.
     // This is too long I think:
@@ -201,9 +265,11 @@ void setupBle()
     BLEDevice::init("Espruino");
     // The minimum power level (-12dbm) ESP_PWR_LVL_N12 was too low
     BLEDevice::setPower(ESP_PWR_LVL_N9);
+    BLEDevice::setCustomGattsHandler(gatts_event_handler);
+    txLock = xSemaphoreCreateMutex();
+    message.reserve(MAX_MESSAGE_SIZE);
 
     // Enable encryption
-    BLEServer* pServer = BLEDevice::createServer();
     BLEDevice::setEncryptionLevel(ESP_BLE_SEC_ENCRYPT_NO_MITM);
     BLEDevice::setSecurityCallbacks(new MySecurity());
 
@@ -226,7 +292,9 @@ void setupBle()
         CHARACTERISTIC_UUID_TX,
         BLECharacteristic::PROPERTY_NOTIFY);
     pTxCharacteristic->setAccessPermissions(ESP_GATT_PERM_READ_ENCRYPTED | ESP_GATT_PERM_WRITE_ENCRYPTED);
-    pTxCharacteristic->addDescriptor(new BLE2902());
+    pTxCharacteristic->setCallbacks(new TxCallbacks());
+    pTxCccd = new BLE2902();
+    pTxCharacteristic->addDescriptor(pTxCccd);
 
     BLECharacteristic *pRxCharacteristic = pService->createCharacteristic(
         CHARACTERISTIC_UUID_RX,
@@ -245,9 +313,18 @@ void setupBle()
     pServer->getAdvertising()->setMaxInterval(5000);
     pServer->getAdvertising()->start();
     Serial.println("BLE advertising...");
+
+    //! setupBle() runs on the boot task, the menu only uses BLE from here on
+    bleEnabled = true;
 }
 
 void bluetooth_event_cb() {
+    if (!bleEnabled) {
+        //! Still starting on the boot task
+        Serial.println("BLE is not ready yet");
+        MenuBar::getMenuBar()->hidden(false);
+        return;
+    }
     // Actually, bluetooth is always advertising currently. This menu button isn't really needed right now.
     restoreMenubars = true;
     pServer->getAdvertising()->start();
@@ -0,0 +1,86 @@
+/*
+    RGB565 fill/copy/blend kernels registered as LVGL's GPU callbacks.
+
+    LVGL hands every fill and image blend above a small area to
+    gpu_fill_cb/gpu_blend_cb when they are set, one line at a time. The
+    kernels in lib/blend565 replace its generic per-pixel loops, this is
+    only the LVGL side of them.
+
+    On the host only the opaque fill and copy beat LVGL, its translucent
+    mix loop vectorises better than the SWAR kernels. Once gpu_blend_cb is
+    set LVGL calls it for every opacity, so translucent lines go through
+    the same lv_color_mix loop LVGL would have used.
+*/
+
+#include "config.h"
+#include <Arduino.h>
+#include "blend565.h"
+#include "blend.h"
+
+#if LV_COLOR_DEPTH == 16
+
+static_assert(sizeof(lv_color_t) == sizeof(uint16_t), "RGB565 pixels are 16 bits");
+static_assert(LV_OPA_20 == BLEND565_OPA_20 && LV_OPA_50 == BLEND565_OPA_50 && LV_OPA_70 == BLEND565_OPA_70 &&
+              LV_OPA_MIN == BLEND565_OPA_MIN && LV_OPA_MAX == BLEND565_OPA_MAX, "LVGL opacity values changed");
+
+void IRAM_ATTR blend_fill(lv_color_t *dest, uint32_t length, lv_color_t color)
+{
+    blend565_fill((uint16_t *)dest, length, color.full);
+}
+
+void IRAM_ATTR blend_map(lv_color_t *dest, const lv_color_t *src, uint32_t length, lv_opa_t opa)
+{
+    blend565_map<LV_COLOR_16_SWAP != 0>((uint16_t *)dest, (const uint16_t *)src, length, opa);
+}
+
+#if BLEND_GPU && LV_USE_GPU
+static void gpu_fill_cb(lv_disp_drv_t *disp_drv, lv_color_t *dest_buf, lv_coord_t dest_width,
+                        const lv_area_t *fill_area, lv_color_t color)
+{
+    lv_coord_t w = lv_area_get_width(fill_area);
+    lv_color_t *line = dest_buf + (int32_t)fill_area->y1 * dest_width + fill_area->x1;
+    for (lv_coord_t y = fill_area->y1; y <= fill_area->y2; y++) {
+        blend_fill(line, w, color);
+        line += dest_width;
+    }
+}
+
+static void gpu_blend_cb(lv_disp_drv_t *disp_drv, lv_color_t *dest, const lv_color_t *src,
+                         uint32_t length, lv_opa_t opa)
+{
+    if (opa >= LV_OPA_MAX) {
+        blend_map(dest, src, length, opa);
+        return;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        dest[i] = lv_color_mix(src[i], dest[i], opa);
+    }
+}
+#endif
+
+void setupBlend()
+{
+#if BLEND_GPU && LV_USE_GPU
+    lv_disp_t *disp = lv_disp_get_default();
+    if (disp == nullptr) return;
+    disp->driver.gpu_fill_cb = gpu_fill_cb;
+    disp->driver.gpu_blend_cb = gpu_blend_cb;
+    Serial.println("Blend: opaque fill and copy kernels installed");
+#elif BLEND_GPU
+    Serial.println("Blend: LV_USE_GPU is off, using LVGL's own loops");
+#endif
+}
+
+#else /* LV_COLOR_DEPTH != 16 */
+
+void setupBlend() {}
+void blend_fill(lv_color_t *dest, uint32_t length, lv_color_t color)
+{
+    for (uint32_t i = 0; i < length; i++) dest[i] = color;
+}
+void blend_map(lv_color_t *dest, const lv_color_t *src, uint32_t length, lv_opa_t opa)
+{
+    for (uint32_t i = 0; i < length; i++) dest[i] = lv_color_mix(src[i], dest[i], opa);
+}
+
+#endif
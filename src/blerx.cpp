@@ -0,0 +1,212 @@
+#include "config.h"
+#include <Arduino.h>
+#include "esp_heap_caps.h"
+#include "ble.h"
+#include "blerx.h"
+
+#define RX_KEY_SIZE 12
+
+typedef enum {
+    RX_SLOT_FREE,
+    //! Being filled by the BLE task or copied out by loop(), outside the lock
+    RX_SLOT_BUSY,
+    RX_SLOT_READY,
+} rx_slot_state_t;
+
+typedef struct {
+    uint8_t state;
+    uint8_t cls;
+    uint16_t len;
+    uint32_t seq;
+    uint32_t receivedUs;
+    //! Type of a superseding message, empty for the rest
+    char key[RX_KEY_SIZE];
+    //! MAX_MESSAGE_SIZE + 1 bytes, in PSRAM
+    char *data;
+} rx_slot_t;
+
+typedef struct {
+    uint32_t received;
+    uint32_t superseded;
+    uint32_t dropped;
+    uint32_t alerts;
+    uint32_t alertTotalUs;
+    uint32_t alertMaxUs;
+} rx_stats_t;
+
+static const char *const classNames[RX_CLASSES] = {"call", "normal", "bulk"};
+//! Only the newest of these matters
+static const char *const supersedeTypes[] = {"musicinfo", "musicstate", "weather"};
+
+static rx_slot_t slots[RX_SLOTS];
+static uint32_t seq = 0;
+static portMUX_TYPE rxMux = portMUX_INITIALIZER_UNLOCKED;
+
+//! The slot being handled is copied out so the BLE task can refill it
+static char *current = nullptr;
+static uint8_t currentCls = RX_CLASS_NORMAL;
+static uint32_t currentUs = 0;
+static bool currentAlerted = false;
+
+static rx_stats_t stats[RX_CLASSES];
+static uint8_t depth = 0;
+static uint8_t maxDepth = 0;
+
+//! Sort a line by the "t" field of its GB() JSON without parsing it
+static rx_class_t classify(const char *msg, size_t len, char *key)
+{
+    key[0] = '\0';
+    if (len < 3 || strncmp(msg, "GB(", 3)) return RX_CLASS_NORMAL;
+    const char *t = strstr(msg, "\"t\":\"");
+    if (t == nullptr) return RX_CLASS_NORMAL;
+    t += 5;
+    const char *end = strchr(t, '"');
+    if (end == nullptr || end - t >= RX_KEY_SIZE) return RX_CLASS_NORMAL;
+
+    if (end - t == 4 && !strncmp(t, "call", 4)) return RX_CLASS_CALL;
+    for (int i = 0; i < sizeof(supersedeTypes) / sizeof(supersedeTypes[0]); i++) {
+        size_t n = strlen(supersedeTypes[i]);
+        if (end - t == n && !strncmp(t, supersedeTypes[i], n)) {
+            memcpy(key, t, n);
+            key[n] = '\0';
+            return RX_CLASS_BULK;
+        }
+    }
+    return RX_CLASS_NORMAL;
+}
+
+void setupRx()
+{
+    //! Several KB each, LVGL and the JSON parser want the internal RAM
+    for (int i = 0; i < RX_SLOTS; i++) {
+        slots[i].data = (char *)heap_caps_malloc(MAX_MESSAGE_SIZE + 1, MALLOC_CAP_SPIRAM);
+    }
+    current = (char *)heap_caps_malloc(MAX_MESSAGE_SIZE + 1, MALLOC_CAP_SPIRAM);
+    for (int i = 0; i < RX_SLOTS; i++) {
+        if (slots[i].data == nullptr || current == nullptr) {
+            Serial.println("BLE RX: no memory for the message slots");
+            current = nullptr;
+            return;
+        }
+    }
+}
+
+bool rx_push(const char *msg, size_t len)
+{
+    char key[RX_KEY_SIZE];
+    rx_class_t cls = classify(msg, len, key);
+    if (len > MAX_MESSAGE_SIZE) len = MAX_MESSAGE_SIZE;
+
+    if (current == nullptr) return false;
+
+    portENTER_CRITICAL(&rxMux);
+    stats[cls].received++;
+    rx_slot_t *slot = nullptr;
+    if (key[0] != '\0') {
+        for (int i = 0; i < RX_SLOTS; i++) {
+            if (slots[i].state == RX_SLOT_READY && !strcmp(slots[i].key, key)) {
+                slot = &slots[i];
+                stats[cls].superseded++;
+                break;
+            }
+        }
+    }
+    if (slot == nullptr) {
+        for (int i = 0; i < RX_SLOTS; i++) {
+            if (slots[i].state == RX_SLOT_FREE) {
+                slot = &slots[i];
+                depth++;
+                break;
+            }
+        }
+    }
+    if (slot == nullptr) {
+        //! Full, push out the newest message of a lower class if there is one
+        for (int i = 0; i < RX_SLOTS; i++) {
+            if (slots[i].state != RX_SLOT_READY || slots[i].cls <= cls) continue;
+            if (slot == nullptr || slots[i].cls > slot->cls ||
+                    (slots[i].cls == slot->cls && slots[i].seq > slot->seq)) {
+                slot = &slots[i];
+            }
+        }
+        if (slot == nullptr) {
+            stats[cls].dropped++;
+            portEXIT_CRITICAL(&rxMux);
+            return false;
+        }
+        stats[slot->cls].dropped++;
+    }
+    if (depth > maxDepth) maxDepth = depth;
+
+    slot->state = RX_SLOT_BUSY;
+    slot->cls = cls;
+    slot->len = len;
+    slot->seq = seq++;
+    slot->receivedUs = micros();
+    strcpy(slot->key, key);
+    portEXIT_CRITICAL(&rxMux);
+
+    //! Up to a few KB to PSRAM, too long to hold the lock for
+    memcpy(slot->data, msg, len);
+    slot->data[len] = '\0';
+    portENTER_CRITICAL(&rxMux);
+    slot->state = RX_SLOT_READY;
+    portEXIT_CRITICAL(&rxMux);
+    return true;
+}
+
+void rx_poll()
+{
+    portENTER_CRITICAL(&rxMux);
+    rx_slot_t *slot = nullptr;
+    for (int i = 0; i < RX_SLOTS; i++) {
+        if (slots[i].state != RX_SLOT_READY) continue;
+        if (slot == nullptr || slots[i].cls < slot->cls ||
+                (slots[i].cls == slot->cls && slots[i].seq < slot->seq)) {
+            slot = &slots[i];
+        }
+    }
+    if (slot == nullptr) {
+        portEXIT_CRITICAL(&rxMux);
+        return;
+    }
+    slot->state = RX_SLOT_BUSY;
+    size_t len = slot->len;
+    currentCls = slot->cls;
+    currentUs = slot->receivedUs;
+    portEXIT_CRITICAL(&rxMux);
+
+    memcpy(current, slot->data, len + 1);
+    portENTER_CRITICAL(&rxMux);
+    slot->state = RX_SLOT_FREE;
+    depth--;
+    portEXIT_CRITICAL(&rxMux);
+
+    currentAlerted = false;
+    ble_process_message(current, len);
+}
+
+void rx_alerted()
+{
+    if (currentAlerted) return;
+    currentAlerted = true;
+    uint32_t us = micros() - currentUs;
+    rx_stats_t *s = &stats[currentCls];
+    s->alerts++;
+    s->alertTotalUs += us;
+    if (us > s->alertMaxUs) s->alertMaxUs = us;
+}
+
+void rx_report()
+{
+    Serial.printf("BLE RX: depth %u, max %u/%u\n", depth, maxDepth, RX_SLOTS);
+    for (int c = 0; c < RX_CLASSES; c++) {
+        rx_stats_t *s = &stats[c];
+        if (s->received == 0) continue;
+        Serial.printf("  %-6s %u received, %u superseded, %u dropped", classNames[c], s->received, s->superseded, s->dropped);
+        if (s->alerts) {
+            Serial.printf(", receive to vibrate avg %u us, max %u us", s->alertTotalUs / s->alerts, s->alertMaxUs);
+        }
+        Serial.println();
+    }
+}
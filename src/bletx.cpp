@@ -0,0 +1,189 @@
+#include "config.h"
+#include <Arduino.h>
+#include <stdarg.h>
+#include "ble.h"
+#include "bletx.h"
+
+typedef struct {
+    uint16_t len;
+    bool action;
+    uint32_t queuedUs;
+    char data[TX_MSG_SIZE];
+} tx_slot_t;
+
+static tx_slot_t slots[TX_SLOTS];
+static uint8_t head = 0;
+static uint8_t count = 0;
+static portMUX_TYPE txMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t txTask = NULL;
+
+static uint8_t packet[TX_SLOTS * TX_MSG_SIZE];
+
+static uint32_t messages = 0;
+static uint32_t bytes = 0;
+static uint32_t notifications = 0;
+static uint32_t dropped = 0;
+static uint32_t truncated = 0;
+static uint32_t retries = 0;
+static uint8_t maxDepth = 0;
+static uint32_t actions = 0;
+static uint32_t actionTotalUs = 0;
+static uint32_t actionMaxUs = 0;
+
+static bool tx_vsend(bool action, const char *fmt, va_list args)
+{
+    if (!ble_connected()) {
+        dropped++;
+        return false;
+    }
+
+    portENTER_CRITICAL(&txMux);
+    if (count == TX_SLOTS) {
+        dropped++;
+        portEXIT_CRITICAL(&txMux);
+        return false;
+    }
+    //! Claim the slot, the task only sends it once len is set
+    tx_slot_t *slot = &slots[(head + count) % TX_SLOTS];
+    slot->len = 0;
+    count++;
+    if (count > maxDepth) maxDepth = count;
+    portEXIT_CRITICAL(&txMux);
+
+    int n = vsnprintf(slot->data, sizeof(slot->data) - 1, fmt, args);
+    if (n < 0 || n >= (int)sizeof(slot->data) - 1) {
+        truncated++;
+        n = n < 0 ? 0 : sizeof(slot->data) - 2;
+    }
+    slot->data[n++] = '\n';
+    slot->action = action;
+    slot->queuedUs = micros();
+    __atomic_store_n(&slot->len, n, __ATOMIC_RELEASE);
+
+    if (txTask != NULL) xTaskNotifyGive(txTask);
+    return true;
+}
+
+bool tx_send(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    bool ok = tx_vsend(false, fmt, args);
+    va_end(args);
+    return ok;
+}
+
+bool tx_action(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    bool ok = tx_vsend(true, fmt, args);
+    va_end(args);
+    return ok;
+}
+
+static void drop_all()
+{
+    portENTER_CRITICAL(&txMux);
+    dropped += count;
+    head = count = 0;
+    portEXIT_CRITICAL(&txMux);
+}
+
+//! Send one packet, waiting out congestion, false once the phone is gone
+static bool send_packet(const uint8_t *data, size_t len)
+{
+    uint32_t backoff = TX_BACKOFF_MS;
+    while (true) {
+        switch (ble_notify_packet(data, len, pdMS_TO_TICKS(50))) {
+        case BLE_TX_OK:
+            notifications++;
+            return true;
+        case BLE_TX_DISCONNECTED:
+            return false;
+        default:
+            retries++;
+            vTaskDelay(pdMS_TO_TICKS(backoff));
+            if (backoff < TX_BACKOFF_MAX_MS) backoff *= 2;
+            break;
+        }
+    }
+}
+
+static void drain()
+{
+    while (true) {
+        size_t payload = ble_payload_size();
+        size_t len = 0;
+        uint8_t taken = 0;
+
+        portENTER_CRITICAL(&txMux);
+        uint8_t queued = count;
+        portEXIT_CRITICAL(&txMux);
+
+        //! Whole lines only, unless a single line is bigger than a notification
+        for (uint8_t i = 0; i < queued; i++) {
+            tx_slot_t *slot = &slots[(head + i) % TX_SLOTS];
+            uint16_t n = __atomic_load_n(&slot->len, __ATOMIC_ACQUIRE);
+            if (n == 0) break;
+            if (len && len + n > payload) break;
+            memcpy(packet + len, slot->data, n);
+            len += n;
+            taken++;
+        }
+        if (taken == 0) return;
+
+        for (size_t off = 0; off < len; off += payload) {
+            if (!send_packet(packet + off, len - off < payload ? len - off : payload)) {
+                drop_all();
+                return;
+            }
+        }
+
+        uint32_t now = micros();
+        for (uint8_t i = 0; i < taken; i++) {
+            tx_slot_t *slot = &slots[(head + i) % TX_SLOTS];
+            if (!slot->action) continue;
+            uint32_t us = now - slot->queuedUs;
+            actions++;
+            actionTotalUs += us;
+            if (us > actionMaxUs) actionMaxUs = us;
+        }
+        messages += taken;
+        bytes += len;
+
+        portENTER_CRITICAL(&txMux);
+        head = (head + taken) % TX_SLOTS;
+        count -= taken;
+        portEXIT_CRITICAL(&txMux);
+    }
+}
+
+static void tx_task(void *arg)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        drain();
+    }
+}
+
+void setupTx()
+{
+    //! Next to the BLE host on core 0, away from loop() and LVGL
+    xTaskCreatePinnedToCore(tx_task, "ble tx", 3072, NULL, 2, &txTask, 0);
+}
+
+uint8_t tx_depth()
+{
+    return count;
+}
+
+void tx_report()
+{
+    Serial.printf("BLE TX: %u messages, %u bytes in %u notifications, %u congestion retries\n",
+                  messages, bytes, notifications, retries);
+    Serial.printf("  depth %u, max %u/%u, %u dropped, %u truncated\n", count, maxDepth, TX_SLOTS, dropped, truncated);
+    if (actions) {
+        Serial.printf("  %u actions, tap to sent avg %u us, max %u us\n", actions, actionTotalUs / actions, actionMaxUs);
+    }
+}
@@ -0,0 +1,80 @@
+/*
+    Boot timeline.
+
+    setup() only brings up what the clock face needs and shows it, the
+    rest (network, BLE) starts on a task on the other core. Every stage
+    records its finish time since the app started, and the timeline is
+    printed once both the first frame is on screen and the watch is
+    advertising.
+*/
+
+#include "config.h"
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "boot.h"
+
+typedef struct {
+    const char *name;
+    uint32_t us;
+    uint8_t core;
+} boot_stage_t;
+
+static boot_stage_t stages[BOOT_MAX_STAGES];
+static uint8_t stageCount = 0;
+static portMUX_TYPE stageMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t firstFrameUs = 0;
+static uint32_t connectableUs = 0;
+
+static void report_once()
+{
+    bool ready;
+    static bool reported = false;
+    portENTER_CRITICAL(&stageMux);
+    ready = firstFrameUs && connectableUs && !reported;
+    if (ready) reported = true;
+    portEXIT_CRITICAL(&stageMux);
+    if (ready) boot_report();
+}
+
+void boot_stage(const char *name)
+{
+    uint32_t us = (uint32_t)esp_timer_get_time();
+    portENTER_CRITICAL(&stageMux);
+    if (stageCount < BOOT_MAX_STAGES) {
+        stages[stageCount].name = name;
+        stages[stageCount].us = us;
+        stages[stageCount].core = xPortGetCoreID();
+        stageCount++;
+    }
+    portEXIT_CRITICAL(&stageMux);
+}
+
+void boot_first_frame()
+{
+    if (firstFrameUs) return;
+    boot_stage("first frame");
+    firstFrameUs = (uint32_t)esp_timer_get_time();
+    report_once();
+}
+
+void boot_connectable()
+{
+    if (connectableUs) return;
+    boot_stage("connectable");
+    connectableUs = (uint32_t)esp_timer_get_time();
+    report_once();
+}
+
+void boot_report()
+{
+    Serial.println("Boot:");
+    uint32_t last[2] = {0, 0};
+    for (int i = 0; i < stageCount; i++) {
+        const boot_stage_t *s = &stages[i];
+        Serial.printf("  %-14s core %u %7u us  +%u us\n", s->name, s->core, s->us, s->us - last[s->core & 1]);
+        last[s->core & 1] = s->us;
+    }
+    Serial.printf("  time to first frame %u ms, time to connectable %u ms\n",
+                  firstFrameUs / 1000, connectableUs / 1000);
+}
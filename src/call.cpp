@@ -0,0 +1,123 @@
+#include "config.h"
+#include <Arduino.h>
+#include "bletx.h"
+#include "fonts.h"
+#include "call.h"
+
+static lv_obj_t *callCont = nullptr;
+static lv_obj_t *nameLabel = nullptr;
+static lv_obj_t *numberLabel = nullptr;
+static lv_task_t *ringTask = nullptr;
+static uint8_t rings = 0;
+
+//! The labels point at these, lv_label_set_text_static() does not copy
+static char nameText[CALL_NAME_SIZE];
+static char numberText[CALL_NUMBER_SIZE];
+
+static void answer_cb(lv_obj_t *obj, lv_event_t event)
+{
+    if (event != LV_EVENT_CLICKED) return;
+    bool accept = lv_obj_get_user_data(obj) != nullptr;
+    tx_action("{\"t\":\"call\",\"n\":\"%s\"}", accept ? "ACCEPT" : "REJECT");
+    call_hide();
+}
+
+static lv_obj_t *create_button(const char *text, lv_color_t color, lv_align_t align, bool accept)
+{
+    static lv_style_t btnStyle;
+    static bool styled = false;
+    if (!styled) {
+        lv_style_init(&btnStyle);
+        lv_style_set_radius(&btnStyle, LV_OBJ_PART_MAIN, LV_RADIUS_CIRCLE);
+        lv_style_set_border_width(&btnStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_text_color(&btnStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        styled = true;
+    }
+    lv_obj_t *btn = lv_btn_create(callCont, NULL);
+    lv_obj_add_style(btn, LV_BTN_PART_MAIN, &btnStyle);
+    lv_obj_set_style_local_bg_color(btn, LV_BTN_PART_MAIN, LV_STATE_DEFAULT, color);
+    lv_obj_set_size(btn, 100, 60);
+    lv_obj_align(btn, NULL, align, align == LV_ALIGN_IN_BOTTOM_LEFT ? 12 : -12, -16);
+    lv_obj_set_user_data(btn, accept ? (void *)1 : nullptr);
+    lv_obj_set_event_cb(btn, answer_cb);
+    lv_obj_t *label = lv_label_create(btn, NULL);
+    lv_label_set_text_static(label, text);
+    return btn;
+}
+
+void setupCall()
+{
+    static lv_style_t contStyle;
+    lv_style_init(&contStyle);
+    lv_style_set_radius(&contStyle, LV_OBJ_PART_MAIN, 0);
+    lv_style_set_bg_color(&contStyle, LV_OBJ_PART_MAIN, LV_COLOR_BLACK);
+    lv_style_set_bg_opa(&contStyle, LV_OBJ_PART_MAIN, LV_OPA_COVER);
+    lv_style_set_border_width(&contStyle, LV_OBJ_PART_MAIN, 0);
+    lv_style_set_text_color(&contStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+    lv_style_set_text_font(&contStyle, LV_STATE_DEFAULT, font_text());
+
+    callCont = lv_cont_create(lv_layer_top(), NULL);
+    lv_obj_set_size(callCont, LV_HOR_RES, LV_VER_RES);
+    lv_obj_add_style(callCont, LV_OBJ_PART_MAIN, &contStyle);
+    lv_obj_set_click(callCont, true);
+
+    lv_obj_t *title = lv_label_create(callCont, NULL);
+    lv_label_set_text_static(title, LV_SYMBOL_BELL " Incoming call");
+    lv_obj_align(title, NULL, LV_ALIGN_IN_TOP_MID, 0, 16);
+
+    nameLabel = lv_label_create(callCont, NULL);
+    lv_label_set_long_mode(nameLabel, LV_LABEL_LONG_DOT);
+    lv_obj_set_width(nameLabel, LV_HOR_RES - 20);
+    lv_label_set_align(nameLabel, LV_LABEL_ALIGN_CENTER);
+    lv_label_set_text_static(nameLabel, nameText);
+    lv_obj_align(nameLabel, NULL, LV_ALIGN_CENTER, 0, -40);
+
+    numberLabel = lv_label_create(callCont, NULL);
+    lv_label_set_long_mode(numberLabel, LV_LABEL_LONG_DOT);
+    lv_obj_set_width(numberLabel, LV_HOR_RES - 20);
+    lv_label_set_align(numberLabel, LV_LABEL_ALIGN_CENTER);
+    lv_label_set_text_static(numberLabel, numberText);
+    lv_obj_align(numberLabel, NULL, LV_ALIGN_CENTER, 0, -10);
+
+    create_button("Accept", LV_COLOR_GREEN, LV_ALIGN_IN_BOTTOM_LEFT, true);
+    create_button("Reject", LV_COLOR_RED, LV_ALIGN_IN_BOTTOM_RIGHT, false);
+    lv_obj_set_hidden(callCont, true);
+
+    //! Keeps buzzing while the call rings, off until one comes in
+    ringTask = lv_task_create([](lv_task_t *task) {
+        if (++rings > CALL_RING_MAX) {
+            lv_task_set_prio(task, LV_TASK_PRIO_OFF);
+            return;
+        }
+        TTGOClass::getWatch()->motor->onec();
+    }, CALL_RING_MS, LV_TASK_PRIO_OFF, nullptr);
+}
+
+void call_show(const char *name, const char *number)
+{
+    if (callCont == nullptr) return;
+    strlcpy(nameText, name != nullptr ? name : "", sizeof(nameText));
+    strlcpy(numberText, number != nullptr ? number : "", sizeof(numberText));
+    lv_label_set_text_static(nameLabel, nameText);
+    lv_label_set_text_static(numberLabel, numberText);
+    //! Above the notification view and anything else on the top layer
+    lv_obj_move_foreground(callCont);
+    lv_obj_set_hidden(callCont, false);
+    lv_disp_trig_activity(NULL);
+
+    rings = 0;
+    lv_task_set_prio(ringTask, LV_TASK_PRIO_MID);
+    lv_task_reset(ringTask);
+}
+
+void call_hide()
+{
+    if (callCont == nullptr) return;
+    lv_task_set_prio(ringTask, LV_TASK_PRIO_OFF);
+    lv_obj_set_hidden(callCont, true);
+}
+
+bool call_active()
+{
+    return callCont != nullptr && !lv_obj_get_hidden(callCont);
+}
@@ -0,0 +1,232 @@
+#include "config.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include "esp_heap_caps.h"
+#include "fonts.h"
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint16_t lineHeight;
+    int16_t baseLine;
+    uint8_t bpp;
+    uint8_t reserved[3];
+    uint32_t blocks;
+    uint32_t glyphs;
+} pack_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t block;
+    uint32_t first;
+    uint32_t count;
+} pack_block_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t codepoint;
+    uint32_t offset;
+    uint8_t advance;
+    uint8_t w;
+    uint8_t h;
+    int8_t ofsX;
+    int8_t ofsY;
+    uint8_t reserved[3];
+} pack_glyph_t;
+
+typedef struct {
+    uint32_t codepoint;
+    uint32_t lastUsed;
+    //! The pack has no such glyph
+    bool absent;
+    pack_glyph_t glyph;
+    uint8_t *bitmap;
+} cache_slot_t;
+
+//! Which font answered the last get_glyph_dsc, LVGL asks for the bitmap right after
+typedef struct {
+    const lv_font_t *primary;
+    bool fromPack;
+} chain_t;
+
+static File pack;
+static volatile bool packReady = false;
+static pack_header_t header;
+static pack_block_t blocks[FONT_MAX_BLOCKS];
+static uint32_t glyphBase = 0;
+
+static cache_slot_t cache[FONT_CACHE_GLYPHS];
+static uint8_t *cacheMem = nullptr;
+static uint32_t tick = 0;
+static cache_slot_t *current = nullptr;
+
+static chain_t textChain;
+static lv_font_t textFont;
+
+static uint32_t lookups = 0;
+static uint32_t primaryHits = 0;
+static uint32_t hits = 0;
+static uint32_t misses = 0;
+static uint32_t absent = 0;
+static uint32_t oversize = 0;
+static uint32_t evictions = 0;
+static uint32_t loadTotalUs = 0;
+static uint32_t loadMaxUs = 0;
+
+static bool read_at(uint32_t offset, void *buf, size_t len)
+{
+    return pack.seek(offset) && pack.read((uint8_t *)buf, len) == len;
+}
+
+//! Binary search the block table in RAM, then the block's glyphs in the file
+static bool find_glyph(uint32_t cp, pack_glyph_t *g)
+{
+    int lo = 0, hi = (int)header.blocks - 1;
+    const pack_block_t *b = nullptr;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (blocks[mid].block == cp >> 8) {
+            b = &blocks[mid];
+            break;
+        }
+        if (blocks[mid].block < cp >> 8) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    if (b == nullptr) return false;
+
+    lo = b->first;
+    hi = b->first + b->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (!read_at(glyphBase + mid * sizeof(pack_glyph_t), g, sizeof(*g))) return false;
+        if (g->codepoint == cp) return true;
+        if (g->codepoint < cp) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return false;
+}
+
+static size_t bitmap_size(const pack_glyph_t *g)
+{
+    return ((size_t)g->w * g->h * header.bpp + 7) / 8;
+}
+
+static cache_slot_t *lookup(uint32_t cp)
+{
+    cache_slot_t *lru = &cache[0];
+    for (int i = 0; i < FONT_CACHE_GLYPHS; i++) {
+        if (cache[i].lastUsed != 0 && cache[i].codepoint == cp) {
+            hits++;
+            cache[i].lastUsed = ++tick;
+            return &cache[i];
+        }
+        if (cache[i].lastUsed < lru->lastUsed) lru = &cache[i];
+    }
+
+    misses++;
+    if (lru->lastUsed != 0) evictions++;
+    uint32_t start = micros();
+    lru->codepoint = cp;
+    lru->lastUsed = ++tick;
+    lru->absent = !find_glyph(cp, &lru->glyph);
+    if (!lru->absent && bitmap_size(&lru->glyph) > FONT_GLYPH_MAX_BYTES) {
+        oversize++;
+        lru->absent = true;
+    }
+    if (!lru->absent && !read_at(lru->glyph.offset, lru->bitmap, bitmap_size(&lru->glyph))) {
+        lru->absent = true;
+    }
+    if (lru->absent) absent++;
+    uint32_t us = micros() - start;
+    loadTotalUs += us;
+    if (us > loadMaxUs) loadMaxUs = us;
+    return lru;
+}
+
+static bool chain_glyph_dsc(const lv_font_t *font, lv_font_glyph_dsc_t *dsc, uint32_t letter, uint32_t next)
+{
+    chain_t *chain = (chain_t *)font->dsc;
+    lookups++;
+    if (lv_font_get_glyph_dsc(chain->primary, dsc, letter, next)) {
+        primaryHits++;
+        chain->fromPack = false;
+        return true;
+    }
+    if (!packReady || letter < 0x80) return false;
+
+    cache_slot_t *slot = lookup(letter);
+    if (slot->absent) return false;
+    current = slot;
+    chain->fromPack = true;
+    dsc->adv_w = slot->glyph.advance;
+    dsc->box_w = slot->glyph.w;
+    dsc->box_h = slot->glyph.h;
+    dsc->ofs_x = slot->glyph.ofsX;
+    dsc->ofs_y = slot->glyph.ofsY;
+    dsc->bpp = header.bpp;
+    return true;
+}
+
+static const uint8_t *chain_glyph_bitmap(const lv_font_t *font, uint32_t letter)
+{
+    chain_t *chain = (chain_t *)font->dsc;
+    if (!chain->fromPack) return lv_font_get_glyph_bitmap(chain->primary, letter);
+    //! A glyph_dsc call for the same letter always comes first
+    if (current == nullptr || current->codepoint != letter || current->absent) return nullptr;
+    return current->bitmap;
+}
+
+void setupFonts()
+{
+    textChain.primary = LV_THEME_DEFAULT_FONT_NORMAL;
+    textChain.fromPack = false;
+    memcpy(&textFont, textChain.primary, sizeof(textFont));
+    textFont.get_glyph_dsc = chain_glyph_dsc;
+    textFont.get_glyph_bitmap = chain_glyph_bitmap;
+    textFont.dsc = &textChain;
+}
+
+void fonts_load_pack()
+{
+    pack = SPIFFS.open(FONT_PACK_PATH, FILE_READ);
+    if (!pack) {
+        Serial.println("Fonts: no font pack, compiled-in glyphs only");
+        return;
+    }
+    if (!read_at(0, &header, sizeof(header)) || memcmp(header.magic, "WFP1", 4) ||
+            header.blocks > FONT_MAX_BLOCKS || (header.bpp != 1 && header.bpp != 2 && header.bpp != 4 && header.bpp != 8) ||
+            !read_at(sizeof(header), blocks, header.blocks * sizeof(pack_block_t))) {
+        Serial.println("Fonts: bad font pack");
+        pack.close();
+        return;
+    }
+    glyphBase = sizeof(header) + header.blocks * sizeof(pack_block_t);
+
+    cacheMem = (uint8_t *)heap_caps_malloc(FONT_CACHE_GLYPHS * FONT_GLYPH_MAX_BYTES, MALLOC_CAP_SPIRAM);
+    if (cacheMem == nullptr) {
+        Serial.println("Fonts: no memory for the glyph cache");
+        pack.close();
+        return;
+    }
+    for (int i = 0; i < FONT_CACHE_GLYPHS; i++) {
+        cache[i].lastUsed = 0;
+        cache[i].bitmap = cacheMem + i * FONT_GLYPH_MAX_BYTES;
+    }
+    Serial.printf("Fonts: pack with %u glyphs in %u blocks, %u bpp\n", header.glyphs, header.blocks, header.bpp);
+    packReady = true;
+}
+
+const lv_font_t *font_text()
+{
+    return &textFont;
+}
+
+void fonts_report()
+{
+    Serial.printf("Fonts: %u lookups, %u compiled-in", lookups, primaryHits);
+    uint32_t packLookups = hits + misses;
+    if (packLookups) {
+        Serial.printf(", pack %u hits / %u misses (%u%%)", hits, misses, hits * 100 / packLookups);
+    }
+    Serial.println();
+    Serial.printf("  %u missing, %u too large, %u evictions, load avg %u us, max %u us, cache %u x %u bytes\n",
+                  absent, oversize, evictions, misses ? loadTotalUs / misses : 0, loadMaxUs,
+                  FONT_CACHE_GLYPHS, FONT_GLYPH_MAX_BYTES);
+}
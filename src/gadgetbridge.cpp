@@ -3,29 +3,27 @@
 #include "ArduinoJson.h"
 #include "gui.h"
 #include "main.h"
+#include "activity.h"
+#include "ble.h"
+#include "bletx.h"
+#include "blerx.h"
+#include "call.h"
+#include "music.h"
+#include "weather.h"
+#include "schedule.h"
+#include "notifyview.h"
+#include "gadgetbridge.h"
 
-StaticJsonDocument<512> json;
-static MBox *mbox = nullptr;
-unsigned long notify_id = 0;
+//! Strings stay in the message buffer (zero-copy), so this only holds the tree
+StaticJsonDocument<1024> json;
 
 void process_gadgetbridge_notify() {
-    notify_id = json["id"];
-    char format[512+3];
     const char* src = json["src"]; // Debug sends "sender"
     const char* title = json["title"]; // Debug sends "subject"
     const char* body = json["body"];
     TTGOClass *ttgo = TTGOClass::getWatch();
 
-    snprintf(format, sizeof(format), "%s: %s\n\n%s", src, title, body);
-    delete mbox;
-    mbox = new MBox;
-    mbox->create(format, [](lv_obj_t *obj, lv_event_t event) {
-        if (event == LV_EVENT_VALUE_CHANGED) {
-            delete mbox;
-            mbox = nullptr;
-            notify_id = 0;
-        }
-    });
+    notify_view_show(json["id"] | 0UL, src, title, body);
 
     // Turn on display if off
     if (!ttgo->bl->isOn()) {
@@ -35,15 +33,139 @@ void process_gadgetbridge_notify() {
     // Trigger vibration
     ttgo->motor->adjust(255);
     ttgo->motor->onec();
+    rx_alerted();
 }
 
-void process_gadgetbridge_json(const char* json_string) {
-    deserializeJson(json, json_string);
+void process_gadgetbridge_call() {
+    const char* cmd = json["cmd"];
+    if (cmd == nullptr) return;
+    if (strcmp(cmd, "incoming")) {
+        //! Answered, ended or rejected, on the watch or the phone
+        if (strcmp(cmd, "outgoing")) call_hide();
+        return;
+    }
+
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    call_show(json["name"], json["number"]);
+    if (!ttgo->bl->isOn()) {
+        xEventGroupSetBits(*get_isr_group(), WATCH_FLAG_SLEEP_EXIT);
+    }
+    ttgo->motor->adjust(255);
+    ttgo->motor->onec();
+    rx_alerted();
+}
+
+void process_gadgetbridge_weather() {
+    //! Zeroed so padding and unused text compare equal between reports
+    weather_t w;
+    memset(&w, 0, sizeof(w));
+    // Temperatures come in Kelvin
+    w.temp = (json["temp"] | 273) - 273;
+    w.hi = (json["hi"] | 273) - 273;
+    w.lo = (json["lo"] | 273) - 273;
+    w.humidity = json["hum"] | 0;
+    w.rain = json["rain"] | 0;
+    w.uv = json["uv"] | 0;
+    w.code = json["code"] | 800;
+    w.wind = (uint16_t)json["wind"].as<float>();
+    w.windDir = json["wdir"] | 0;
+    strlcpy(w.text, json["txt"] | "", sizeof(w.text));
+    strlcpy(w.location, json["loc"] | "", sizeof(w.location));
+    weather_update(&w);
+}
+
+void process_gadgetbridge_alarms() {
+    //! The phone sends every alarm each time
+    schedule_clear_alarms();
+    JsonArray alarms = json["d"];
+    for (JsonObject a : alarms) {
+        if (!(a["on"] | true)) continue;
+        schedule_add_alarm(a["h"] | 0, a["m"] | 0, a["rep"] | 0);
+    }
+    schedule_commit();
+}
+
+void process_gadgetbridge_json(char* json_string) {
+    DeserializationError err = deserializeJson(json, json_string);
+    if (err) {
+        Serial.printf("GB JSON error: %s\n", err.c_str());
+        return;
+    }
 
     const char* t = json["t"];
-    if (!strcmp(t, "notify")) {
+    if (t == nullptr) {
+        return;
+    } else if (!strcmp(t, "call")) {
+        process_gadgetbridge_call();
+    } else if (!strcmp(t, "notify")) {
         process_gadgetbridge_notify();
+    } else if (!strcmp(t, "musicinfo")) {
+        music_set_info(json["artist"], json["album"], json["track"], json["dur"] | 0);
+    } else if (!strcmp(t, "musicstate")) {
+        music_set_state(json["state"], json["position"] | -1);
+    } else if (!strcmp(t, "weather")) {
+        process_gadgetbridge_weather();
+    } else if (!strcmp(t, "alarm")) {
+        process_gadgetbridge_alarms();
+    } else if (!strcmp(t, "calendar")) {
+        schedule_add_calendar(json["id"] | 0UL, json["timestamp"] | 0UL, json["durationInSeconds"] | 0UL, json["title"]);
+        schedule_commit();
+    } else if (!strcmp(t, "calendar-")) {
+        schedule_remove_calendar(json["id"] | 0UL);
+        schedule_commit();
+    } else if (!strcmp(t, "actfetch")) {
+        //! Phone asks for history since ts (ms), without one resume from our cursor
+        uint64_t ts = json["ts"] | 0ULL;
+        activity_sync((uint32_t)(ts / 1000));
     } else {
         Serial.printf("Unhandled GB type: %s\n", t);
     }
 }
+
+static bool statusValid = false;
+static int statusBat = 0;
+static bool statusChg = false;
+static int statusMv = 0;
+static uint32_t statusSentMs = 0;
+static uint32_t statusPollMs = 0;
+static uint32_t statusSent = 0;
+static uint32_t statusSuppressed = 0;
+
+void gadgetbridge_status_poll()
+{
+    if (!ble_connected()) {
+        //! Tell a phone that (re)connects right away
+        statusValid = false;
+        return;
+    }
+    uint32_t now = millis();
+    if (statusValid && now - statusPollMs < STATUS_POLL_MS) return;
+    statusPollMs = now;
+
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    int bat = ttgo->power->getBattPercentage();
+    bool chg = ttgo->power->isChargeing();
+    int mv = (int)ttgo->power->getBattVoltage();
+
+    if (statusValid && chg == statusChg && abs(bat - statusBat) < STATUS_BAT_DELTA &&
+            abs(mv - statusMv) < STATUS_VOLT_DELTA_MV && now - statusSentMs < STATUS_MAX_INTERVAL_MS) {
+        statusSuppressed++;
+        return;
+    }
+    if (!tx_send("{\"t\":\"status\",\"bat\":%d,\"chg\":%d,\"volt\":%d.%02d}", bat, chg, mv / 1000, mv % 1000 / 10)) {
+        return;
+    }
+    statusValid = true;
+    statusBat = bat;
+    statusChg = chg;
+    statusMv = mv;
+    statusSentMs = now;
+    statusSent++;
+}
+
+void gadgetbridge_report()
+{
+    Serial.printf("Gadgetbridge: %u status updates sent, %u suppressed\n", statusSent, statusSuppressed);
+    rx_report();
+    tx_report();
+}
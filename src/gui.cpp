@@ -18,34 +18,31 @@ Created by Lewis he on October 10, 2019.
 #include "FS.h"
 #include "SD.h"
 #include "ble.h"
+#include "screen.h"
+#include "pool.h"
+#include "lvmem.h"
+#include "ntpclient.h"
+#include "timekeeper.h"
+#include "wificache.h"
+#include "wifiscan.h"
+#include "radio.h"
+#include "music.h"
+#include "weather.h"
+#include "schedule.h"
+#include "assets.h"
 
 #define RTC_TIME_ZONE   "CST-8"
 
 LV_FONT_DECLARE(Geometr);
 LV_FONT_DECLARE(Ubuntu);
-LV_IMG_DECLARE(bg);
-LV_IMG_DECLARE(bg1);
-LV_IMG_DECLARE(bg2);
-LV_IMG_DECLARE(bg3);
-LV_IMG_DECLARE(WALLPAPER_1_IMG);
-LV_IMG_DECLARE(WALLPAPER_2_IMG);
-LV_IMG_DECLARE(WALLPAPER_3_IMG);
-LV_IMG_DECLARE(step);
-LV_IMG_DECLARE(menu);
-
-LV_IMG_DECLARE(wifi);
-LV_IMG_DECLARE(light);
-LV_IMG_DECLARE(bluetooth);
-LV_IMG_DECLARE(sd);
-LV_IMG_DECLARE(setting);
-LV_IMG_DECLARE(on);
-LV_IMG_DECLARE(off);
-LV_IMG_DECLARE(level1);
-LV_IMG_DECLARE(level2);
-LV_IMG_DECLARE(level3);
-LV_IMG_DECLARE(iexit);
-LV_IMG_DECLARE(modules);
-LV_IMG_DECLARE(CAMERA_PNG);
+
+//! Images live in the assets partition, see include/assets.h. Resolved
+//! once in setupGui so the switch images can be compared by pointer.
+static const void *imgStep = LV_SYMBOL_SHUFFLE;
+static const void *imgMenu = LV_SYMBOL_LIST;
+static const void *imgOn = LV_SYMBOL_OK;
+static const void *imgOff = LV_SYMBOL_CLOSE;
+static const void *imgExit = LV_SYMBOL_LEFT;
 
 extern EventGroupHandle_t g_event_group;
 extern QueueHandle_t g_event_queue_handle;
@@ -55,8 +52,6 @@ static lv_obj_t *mainBar = nullptr;
 static lv_obj_t *timeLabel = nullptr;
 static lv_obj_t *menuBtn = nullptr;
 
-static uint8_t globalIndex = 0;
-
 static void lv_update_task(struct _lv_task_t *);
 static void lv_battery_task(struct _lv_task_t *);
 static void updateTime();
@@ -68,7 +63,6 @@ static void setting_event_cb();
 static void light_event_cb();
 static void modules_event_cb();
 static void camera_event_cb();
-static void wifi_destory();
 
 MenuBar menuBars;
 StatusBar bar;
@@ -117,7 +111,7 @@ void StatusBar::createIcons(lv_obj_t *par)
 
     //step counter
     _array[4].icon = lv_img_create(_bar, NULL);
-    lv_img_set_src(_array[4].icon, &step);
+    lv_img_set_src(_array[4].icon, imgStep);
     lv_obj_align(_array[4].icon, _bar, LV_ALIGN_IN_LEFT_MID, 10, 0);
 
     _array[5].icon = lv_label_create(_bar, NULL);
@@ -188,11 +182,23 @@ MenuBar::MenuBar()
     _cont = nullptr;
     _view = nullptr;
     _exit = nullptr;
-    _obj = nullptr;
+    _cfg = nullptr;
+    _event_cb = nullptr;
     _vp = nullptr;
+    memset(_tiles, 0, sizeof(_tiles));
 };
 
-MenuBar::~MenuBar() {};
+MenuBar::~MenuBar()
+{
+    if (_cont != nullptr) {
+        lv_obj_del(_cont);
+    }
+    if (_exit != nullptr) {
+        lv_obj_del(_exit);
+    }
+    delete[] _vp;
+    _vp = nullptr;
+};
 
 MenuBar* MenuBar::getMenuBar()
 {
@@ -201,21 +207,30 @@ MenuBar* MenuBar::getMenuBar()
 
 void MenuBar::createMenu(lv_menu_config_t *config, int count, lv_event_cb_t event_cb, int direction)
 {
+    uint32_t start = micros();
+    uint32_t before = lvmem_used();
+
+    //! Shared by every menu, so only set up once: re-initialising it would
+    //! orphan its property map while the live menu still uses it
     static lv_style_t menuStyle;
-    lv_style_init(&menuStyle);
-    lv_style_set_radius(&menuStyle, LV_OBJ_PART_MAIN, 0);
-    lv_style_set_bg_color(&menuStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
-    lv_style_set_bg_opa(&menuStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
-    lv_style_set_border_width(&menuStyle, LV_OBJ_PART_MAIN, 0);
-    lv_style_set_text_color(&menuStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
-    lv_style_set_image_recolor(&menuStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+    static bool styled = false;
+    if (!styled) {
+        lv_style_init(&menuStyle);
+        lv_style_set_radius(&menuStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_bg_color(&menuStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
+        lv_style_set_bg_opa(&menuStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
+        lv_style_set_border_width(&menuStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_text_color(&menuStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        lv_style_set_image_recolor(&menuStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        styled = true;
+    }
 
     _count = count;
+    _cfg = config;
+    _event_cb = event_cb;
 
     _vp = new lv_point_t [count];
 
-    _obj = new lv_obj_t *[count];
-
     for (int i = 0; i < count; i++) {
         if (direction) {
             _vp[i].x = 0;
@@ -237,37 +252,101 @@ void MenuBar::createMenu(lv_menu_config_t *config, int count, lv_event_cb_t even
     lv_obj_align(_view, NULL, LV_ALIGN_CENTER, 0, 0);
     lv_page_set_scrlbar_mode(_view, LV_SCRLBAR_MODE_OFF);
     lv_obj_add_style(_view, LV_OBJ_PART_MAIN, &menuStyle);
+    lv_obj_set_event_cb(_view, __view_event_cb);
+
+    _w = lv_obj_get_width(_view) ;
+    _h = lv_obj_get_height(_view);
+
+    //! The tiles don't all exist, so the scrollable can't fit to them
+    lv_page_set_scrollable_fit(_view, LV_FIT_NONE);
+    lv_obj_set_size(lv_page_get_scrollable(_view), direction ? _w : _w * count, direction ? _h * count : _h);
+
+    for (int i = 0; i < TILE_SLOTS; i++) {
+        tile_t *tile = &_tiles[i];
+        tile->index = -1;
+        tile->cont = lv_cont_create(_view, _view);
+        lv_obj_set_size(tile->cont, _w, _h);
+        tile->img = lv_img_create(tile->cont, NULL);
+        tile->label = lv_label_create(tile->cont, NULL);
+        lv_tileview_add_element(_view, tile->cont);
+        lv_obj_set_click(tile->cont, true);
+        lv_obj_set_event_cb(tile->cont, event_cb);
+        lv_obj_set_hidden(tile->cont, true);
+    }
 
-    lv_coord_t _w = lv_obj_get_width(_view) ;
-    lv_coord_t _h = lv_obj_get_height(_view);
+    _menu = this;
+    load(0);
 
-    for (int i = 0; i < count; i++) {
-        _obj[i] = lv_cont_create(_view, _view);
-        lv_obj_set_size(_obj[i], _w, _h);
+    _exit  = lv_imgbtn_create(lv_scr_act(), NULL);
+    lv_imgbtn_set_src(_exit, LV_BTN_STATE_RELEASED, imgMenu);
+    lv_imgbtn_set_src(_exit, LV_BTN_STATE_PRESSED, imgMenu);
+    lv_imgbtn_set_src(_exit, LV_BTN_STATE_CHECKED_PRESSED, imgMenu);
+    lv_imgbtn_set_src(_exit, LV_BTN_STATE_CHECKED_RELEASED, imgMenu);
+    lv_obj_align(_exit, NULL, LV_ALIGN_IN_BOTTOM_RIGHT, -20, -20);
+    lv_obj_set_event_cb(_exit, event_cb);
+    lv_obj_set_top(_exit, true);
 
-        lv_obj_t *img = lv_img_create(_obj[i], NULL);
-        lv_img_set_src(img, config[i].img);
-        lv_obj_align(img, _obj[i], LV_ALIGN_CENTER, 0, 0);
+    Serial.printf("Menu: %d entries, %d tiles, %u us, %d bytes\n", count, TILE_SLOTS,
+                  micros() - start, (int)(lvmem_used() - before));
+}
 
-        lv_obj_t *label = lv_label_create(_obj[i], NULL);
-        lv_label_set_text(label, config[i].name);
-        lv_obj_align(label, img, LV_ALIGN_OUT_BOTTOM_MID, 0, 0);
+void MenuBar::load(int center)
+{
+    bool wanted[TILE_SLOTS];
+    for (int i = 0; i < TILE_SLOTS; i++) {
+        int index = _tiles[i].index;
+        wanted[i] = index >= 0 && index >= center - 1 && index <= center + 1;
+    }
 
-        i == 0 ? lv_obj_align(_obj[i], NULL, LV_ALIGN_CENTER, 0, 0) : lv_obj_align(_obj[i], _obj[i - 1], direction ? LV_ALIGN_OUT_BOTTOM_MID : LV_ALIGN_OUT_RIGHT_MID, 0, 0);
+    for (int index = center - 1; index <= center + 1; index++) {
+        if (index < 0 || index >= _count) continue;
+        bool bound = false;
+        for (int i = 0; i < TILE_SLOTS; i++) {
+            if (_tiles[i].index == index) {
+                bound = true;
+                break;
+            }
+        }
+        if (bound) continue;
+        for (int i = 0; i < TILE_SLOTS; i++) {
+            if (!wanted[i]) {
+                bind(&_tiles[i], index);
+                wanted[i] = true;
+                break;
+            }
+        }
+    }
 
-        lv_tileview_add_element(_view, _obj[i]);
-        lv_obj_set_click(_obj[i], true);
-        lv_obj_set_event_cb(_obj[i], event_cb);
+    for (int i = 0; i < TILE_SLOTS; i++) {
+        if (!wanted[i]) {
+            _tiles[i].index = -1;
+            lv_obj_set_hidden(_tiles[i].cont, true);
+        }
     }
+}
 
-    _exit  = lv_imgbtn_create(lv_scr_act(), NULL);
-    lv_imgbtn_set_src(_exit, LV_BTN_STATE_RELEASED, &menu);
-    lv_imgbtn_set_src(_exit, LV_BTN_STATE_PRESSED, &menu);
-    lv_imgbtn_set_src(_exit, LV_BTN_STATE_CHECKED_PRESSED, &menu);
-    lv_imgbtn_set_src(_exit, LV_BTN_STATE_CHECKED_RELEASED, &menu);
-    lv_obj_align(_exit, NULL, LV_ALIGN_IN_BOTTOM_RIGHT, -20, -20);
-    lv_obj_set_event_cb(_exit, event_cb);
-    lv_obj_set_top(_exit, true);
+void MenuBar::bind(tile_t *tile, int index)
+{
+    tile->index = index;
+    lv_img_set_src(tile->img, _cfg[index].img);
+    lv_obj_align(tile->img, tile->cont, LV_ALIGN_CENTER, 0, 0);
+    lv_label_set_text_static(tile->label, _cfg[index].name);
+    lv_obj_align(tile->label, tile->img, LV_ALIGN_OUT_BOTTOM_MID, 0, 0);
+    lv_obj_set_pos(tile->cont, _vp[index].x * _w, _vp[index].y * _h);
+    lv_obj_set_hidden(tile->cont, false);
+}
+
+void MenuBar::__view_event_cb(lv_obj_t *obj, lv_event_t event)
+{
+    if (event != LV_EVENT_VALUE_CHANGED) return;
+    lv_coord_t x, y;
+    lv_tileview_get_tile_act(obj, &x, &y);
+    for (int i = 0; i < _menu->_count; i++) {
+        if (_menu->_vp[i].x == x && _menu->_vp[i].y == y) {
+            _menu->load(i);
+            return;
+        }
+    }
 }
 
 lv_obj_t* MenuBar::exitBtn() const
@@ -288,16 +367,78 @@ void MenuBar::hidden(bool en)
 
 lv_obj_t* MenuBar::obj(int index) const
 {
-    if (index > _count)return nullptr;
-    return _obj[index];
+    for (int i = 0; i < TILE_SLOTS; i++) {
+        if (_tiles[i].index == index) return _tiles[i].cont;
+    }
+    return nullptr;
+}
+
+int MenuBar::indexOf(const lv_obj_t *obj) const
+{
+    for (int i = 0; i < TILE_SLOTS; i++) {
+        if (_tiles[i].cont == obj) return _tiles[i].index;
+    }
+    return -1;
 }
 
-MenuBar::lv_menu_config_t _cfg[3] = {
-    {.name = "Bluetooth",  .img = (void *) &bluetooth, .event_cb = bluetooth_event_cb},
-    {.name = "WiFi",  .img = (void *) &wifi, .event_cb = wifi_event_cb},
+//! Builds a hidden throwaway menu of count entries and scrolls through all of
+//! it, to check that memory and scroll cost don't grow with the entry count
+void MenuBar::bench(int count)
+{
+    static const char *symbols[] = {
+        LV_SYMBOL_BLUETOOTH, LV_SYMBOL_WIFI, LV_SYMBOL_AUDIO, LV_SYMBOL_SETTINGS
+    };
+    typedef char name_t[12];
+    lv_menu_config_t *config = new lv_menu_config_t [count];
+    name_t *names = new name_t [count];
+    for (int i = 0; i < count; i++) {
+        snprintf(names[i], sizeof(names[i]), "Entry %d", i);
+        config[i].name = names[i];
+        config[i].img = (void *) symbols[i % 4];
+        config[i].event_cb = nullptr;
+    }
+
+    MenuBar *active = _menu;
+    uint32_t before = lvmem_used();
+    uint32_t start = micros();
+    MenuBar *menu = new MenuBar();
+    menu->createMenu(config, count, nullptr);
+    uint32_t created = micros() - start;
+    menu->hidden(true);
+    uint32_t built = lvmem_used() - before;
+
+    uint32_t total = 0, worst = 0, peak = built;
+    for (int i = 1; i < count; i++) {
+        start = micros();
+        menu->load(i);
+        uint32_t us = micros() - start;
+        total += us;
+        if (us > worst) worst = us;
+        uint32_t used = lvmem_used() - before;
+        if (used > peak) peak = used;
+    }
+
+    delete menu;
+    _menu = active;
+    int leaked = (int)(lvmem_used() - before);
+    delete[] names;
+    delete[] config;
+
+    Serial.printf("Menu bench: %d entries, create %u us, %u bytes built, %u bytes peak, %d bytes after delete\n",
+                  count, created, built, peak, leaked);
+    Serial.printf("Menu bench: %d scrolls, %u us avg, %u us worst\n",
+                  count - 1, count > 1 ? total / (count - 1) : 0, worst);
+}
+
+MenuBar *MenuBar::_menu = nullptr;
+
+MenuBar::lv_menu_config_t _cfg[4] = {
+    {.name = "Bluetooth",  .img = (void *) LV_SYMBOL_BLUETOOTH, .event_cb = bluetooth_event_cb},
+    {.name = "WiFi",  .img = (void *) LV_SYMBOL_WIFI, .event_cb = wifi_event_cb},
+    {.name = "Music",  .img = (void *) LV_SYMBOL_AUDIO, .event_cb = music_event_cb},
     // {.name = "SD Card",  .img = (void *) &sd,  /*.event_cb =sd_event_cb*/},
     // {.name = "Light",  .img = (void *) &light, /*.event_cb = light_event_cb*/},
-    {.name = "Setting",  .img = (void *) &setting, /*.event_cb = setting_event_cb */},
+    {.name = "Setting",  .img = (void *) LV_SYMBOL_SETTINGS, /*.event_cb = setting_event_cb */},
     // {.name = "Modules",  .img = (void *) &modules, /*.event_cb = modules_event_cb */},
     // {.name = "Camera",  .img = (void *) &CAMERA_PNG, /*.event_cb = camera_event_cb*/ }
 };
@@ -329,14 +470,30 @@ void setupGui()
     lv_style_set_text_color(&settingStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
     lv_style_set_image_recolor(&settingStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
 
-    //Create wallpaper
-    void *images[] = {(void *) &bg, (void *) &bg1, (void *) &bg2, (void *) &bg3 };
+    imgStep = ASSET_SRC(step, imgStep);
+    imgMenu = ASSET_SRC(menu, imgMenu);
+    imgOn = ASSET_SRC(on, imgOn);
+    imgOff = ASSET_SRC(off, imgOff);
+    imgExit = ASSET_SRC(iexit, imgExit);
+    _cfg[0].img = (void *) ASSET_SRC(bluetooth, _cfg[0].img);
+    _cfg[1].img = (void *) ASSET_SRC(wifi, _cfg[1].img);
+    _cfg[3].img = (void *) ASSET_SRC(setting, _cfg[3].img);
+
+    //Create wallpaper from the backgrounds present in the assets partition
+    const void *bgs[] = {ASSET_SRC(bg, NULL), ASSET_SRC(bg1, NULL), ASSET_SRC(bg2, NULL), ASSET_SRC(bg3, NULL)};
+    const void *images[4];
+    int n = 0;
+    for (int i = 0; i < 4; i++) {
+        if (bgs[i] != nullptr) images[n++] = bgs[i];
+    }
     lv_obj_t *scr = lv_scr_act();
-    lv_obj_t *img_bin = lv_img_create(scr, NULL);  /*Create an image object*/
-    srand((int)time(0));
-    int r = rand() % 4;
-    lv_img_set_src(img_bin, images[r]);
-    lv_obj_align(img_bin, NULL, LV_ALIGN_CENTER, 0, 0);
+    if (n > 0) {
+        lv_obj_t *img_bin = lv_img_create(scr, NULL);  /*Create an image object*/
+        srand((int)time(0));
+        int r = rand() % n;
+        lv_img_set_src(img_bin, images[r]);
+        lv_obj_align(img_bin, NULL, LV_ALIGN_CENTER, 0, 0);
+    }
 
     //! bar
     bar.createIcons(scr);
@@ -383,16 +540,20 @@ void setupGui()
 
     menuBtn = lv_imgbtn_create(mainBar, NULL);
 
-    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_ACTIVE, &menu);
-    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_RELEASED, &menu);
-    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_PRESSED, &menu);
-    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_CHECKED_RELEASED, &menu);
-    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_CHECKED_PRESSED, &menu);
+    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_ACTIVE, imgMenu);
+    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_RELEASED, imgMenu);
+    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_PRESSED, imgMenu);
+    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_CHECKED_RELEASED, imgMenu);
+    lv_imgbtn_set_src(menuBtn, LV_BTN_STATE_CHECKED_PRESSED, imgMenu);
     lv_obj_add_style(menuBtn, LV_OBJ_PART_MAIN, &style_pr);
 
     lv_obj_align(menuBtn, mainBar, LV_ALIGN_OUT_BOTTOM_MID, 0, -70);
     lv_obj_set_event_cb(menuBtn, event_handler);
 
+    //! weather, last report from NVS until the phone sends a new one
+    setupWeather();
+    weather_create(mainBar);
+
     lv_task_create(lv_update_task, 1000, LV_TASK_PRIO_LOWEST, NULL);
     lv_task_create(lv_battery_task, 30000, LV_TASK_PRIO_LOWEST, NULL);
 }
@@ -447,21 +608,16 @@ static void lv_battery_task(struct _lv_task_t *data)
 
 static void view_event_handler(lv_obj_t *obj, lv_event_t event)
 {
-    int size = sizeof(_cfg) / sizeof(_cfg[0]);
     if (event == LV_EVENT_SHORT_CLICKED) {
         if (obj == menuBars.exitBtn()) {
             menuBars.hidden();
             lv_obj_set_hidden(mainBar, false);
             return;
         }
-        for (int i = 0; i < size; i++) {
-            if (obj == menuBars.obj(i)) {
-                if (_cfg[i].event_cb != nullptr) {
-                    menuBars.hidden();
-                    _cfg[i].event_cb();
-                }
-                return;
-            }
+        int i = menuBars.indexOf(obj);
+        if (i >= 0 && _cfg[i].event_cb != nullptr) {
+            menuBars.hidden();
+            _cfg[i].event_cb();
         }
     }
 }
@@ -486,15 +642,22 @@ Keyboard::~Keyboard()
 
 void Keyboard::create(lv_obj_t *parent)
 {
+    //! Shared by every keyboard, so it must not live in the arena of the
+    //! screen that happens to create the first one
     static lv_style_t kbStyle;
-
-    lv_style_init(&kbStyle);
-    lv_style_set_radius(&kbStyle, LV_OBJ_PART_MAIN, 0);
-    lv_style_set_bg_color(&kbStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
-    lv_style_set_bg_opa(&kbStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
-    lv_style_set_border_width(&kbStyle, LV_OBJ_PART_MAIN, 0);
-    lv_style_set_text_color(&kbStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
-    lv_style_set_image_recolor(&kbStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+    static bool styled = false;
+    if (!styled) {
+        int arena = lvmem_arena_suspend();
+        lv_style_init(&kbStyle);
+        lv_style_set_radius(&kbStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_bg_color(&kbStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
+        lv_style_set_bg_opa(&kbStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
+        lv_style_set_border_width(&kbStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_text_color(&kbStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        lv_style_set_image_recolor(&kbStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        lvmem_arena_resume(arena);
+        styled = true;
+    }
 
     if (parent == nullptr) {
         parent = lv_scr_act();
@@ -506,6 +669,7 @@ void Keyboard::create(lv_obj_t *parent)
     lv_obj_add_style(_kbCont, LV_OBJ_PART_MAIN, &kbStyle);
 
     lv_obj_t *ta = lv_textarea_create(_kbCont, NULL);
+    _ta = ta;
     lv_obj_set_height(ta, 40);
     lv_textarea_set_one_line(ta, true);
     lv_textarea_set_pwd_mode(ta, false);
@@ -575,6 +739,13 @@ const char* Keyboard::getText()
 void Keyboard::hidden(bool en)
 {
     lv_obj_set_hidden(_kbCont, en);
+    if (!en) _kb = this;
+}
+
+void Keyboard::clear()
+{
+    lv_textarea_set_text(_ta, "");
+    __buf[0] = '\0';
 }
 
 char Keyboard::__buf[128];
@@ -663,14 +834,20 @@ Switch::~Switch()
 void Switch::create(switch_cfg_t *cfg, uint8_t count, exit_cb cb, lv_obj_t *parent)
 {
     static lv_style_t swlStyle;
-    lv_style_init(&swlStyle);
-    lv_style_set_radius(&swlStyle, LV_OBJ_PART_MAIN, 0);
-    lv_style_set_bg_color(&swlStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
-    lv_style_set_bg_opa(&swlStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
-    lv_style_set_border_width(&swlStyle, LV_OBJ_PART_MAIN, 0);
-    lv_style_set_border_opa(&swlStyle, LV_OBJ_PART_MAIN, LV_OPA_50);
-    lv_style_set_text_color(&swlStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
-    lv_style_set_image_recolor(&swlStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+    static bool styled = false;
+    if (!styled) {
+        int arena = lvmem_arena_suspend();
+        lv_style_init(&swlStyle);
+        lv_style_set_radius(&swlStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_bg_color(&swlStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
+        lv_style_set_bg_opa(&swlStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
+        lv_style_set_border_width(&swlStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_border_opa(&swlStyle, LV_OBJ_PART_MAIN, LV_OPA_50);
+        lv_style_set_text_color(&swlStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        lv_style_set_image_recolor(&swlStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        lvmem_arena_resume(arena);
+        styled = true;
+    }
 
     if (parent == nullptr) {
         parent = lv_scr_act();
@@ -682,9 +859,10 @@ void Switch::create(switch_cfg_t *cfg, uint8_t count, exit_cb cb, lv_obj_t *pare
     lv_obj_align(_swCont, NULL, LV_ALIGN_CENTER, 0, 0);
     lv_obj_add_style(_swCont, LV_OBJ_PART_MAIN, &swlStyle);
 
+    if (count > SWITCH_MAX_COUNT) {
+        count = SWITCH_MAX_COUNT;
+    }
     _count = count;
-    _sw = new lv_obj_t *[count];
-    _cfg = new switch_cfg_t [count];
 
     memcpy(_cfg, cfg, sizeof(switch_cfg_t) * count);
 
@@ -694,11 +872,11 @@ void Switch::create(switch_cfg_t *cfg, uint8_t count, exit_cb cb, lv_obj_t *pare
         lv_label_set_text(la1, cfg[i].name);
         i == 0 ? lv_obj_align(la1, NULL, LV_ALIGN_IN_TOP_LEFT, 30, 20) : lv_obj_align(la1, prev, LV_ALIGN_OUT_BOTTOM_MID, 0, 20);
         _sw[i] = lv_imgbtn_create(_swCont, NULL);
-        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_ACTIVE, &off);
-        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_RELEASED, &off);
-        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_PRESSED, &off);
-        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_CHECKED_RELEASED, &off);
-        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_CHECKED_PRESSED, &off);
+        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_ACTIVE, imgOff);
+        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_RELEASED, imgOff);
+        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_PRESSED, imgOff);
+        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_CHECKED_RELEASED, imgOff);
+        lv_imgbtn_set_src(_sw[i], LV_BTN_STATE_CHECKED_PRESSED, imgOff);
         lv_obj_set_click(_sw[i], true);
 
         lv_obj_align(_sw[i], la1, LV_ALIGN_OUT_RIGHT_MID, 80, 0);
@@ -707,11 +885,11 @@ void Switch::create(switch_cfg_t *cfg, uint8_t count, exit_cb cb, lv_obj_t *pare
     }
 
     _exitBtn = lv_imgbtn_create(_swCont, NULL);
-    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_ACTIVE, &iexit);
-    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_RELEASED, &iexit);
-    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_PRESSED, &iexit);
-    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_CHECKED_RELEASED, &iexit);
-    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_CHECKED_PRESSED, &iexit);
+    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_ACTIVE, imgExit);
+    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_RELEASED, imgExit);
+    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_PRESSED, imgExit);
+    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_CHECKED_RELEASED, imgExit);
+    lv_imgbtn_set_src(_exitBtn, LV_BTN_STATE_CHECKED_PRESSED, imgExit);
     lv_obj_set_click(_exitBtn, true);
 
     lv_obj_align(_exitBtn, _swCont, LV_ALIGN_IN_BOTTOM_MID, 0, -5);
@@ -728,6 +906,7 @@ void Switch::align(const lv_obj_t *base, lv_align_t align, lv_coord_t x, lv_coor
 void Switch::hidden(bool en)
 {
     lv_obj_set_hidden(_swCont, en);
+    if (!en) _switch = this;
 }
 
 void Switch::__switch_event_cb(lv_obj_t *obj, lv_event_t event)
@@ -748,8 +927,8 @@ void Switch::__switch_event_cb(lv_obj_t *obj, lv_event_t event)
             lv_obj_t *sw = _switch->_sw[i];
             if (obj == sw) {
                 const void *src =  lv_imgbtn_get_src(sw, LV_BTN_STATE_RELEASED);
-                const void *dst = src == &off ? &on : &off;
-                bool en = src == &off;
+                const void *dst = src == imgOff ? imgOn : imgOff;
+                bool en = src == imgOff;
                 lv_imgbtn_set_src(sw, LV_BTN_STATE_ACTIVE, dst);
                 lv_imgbtn_set_src(sw, LV_BTN_STATE_RELEASED, dst);
                 lv_imgbtn_set_src(sw, LV_BTN_STATE_PRESSED, dst);
@@ -766,9 +945,9 @@ void Switch::__switch_event_cb(lv_obj_t *obj, lv_event_t event)
 
 void Switch::setStatus(uint8_t index, bool en)
 {
-    if (index > _count)return;
+    if (index >= _count)return;
     lv_obj_t *sw = _sw[index];
-    const void *dst =  en ? &on : &off;
+    const void *dst =  en ? imgOn : imgOff;
     lv_imgbtn_set_src(sw, LV_BTN_STATE_ACTIVE, dst);
     lv_imgbtn_set_src(sw, LV_BTN_STATE_RELEASED, dst);
     lv_imgbtn_set_src(sw, LV_BTN_STATE_PRESSED, dst);
@@ -803,22 +982,28 @@ void Preload::create(lv_obj_t *parent)
     }
     if (_preloadCont == nullptr) {
         static lv_style_t plStyle;
-        lv_style_init(&plStyle);
-        lv_style_set_radius(&plStyle, LV_OBJ_PART_MAIN, 0);
-        lv_style_set_bg_color(&plStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
-        lv_style_set_bg_opa(&plStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
-        lv_style_set_border_width(&plStyle, LV_OBJ_PART_MAIN, 0);
-        lv_style_set_text_color(&plStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
-        lv_style_set_image_recolor(&plStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
-
         static lv_style_t style;
-        lv_style_init(&style);
-        lv_style_set_radius(&style, LV_OBJ_PART_MAIN, 0);
-        lv_style_set_bg_color(&style, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
-        lv_style_set_bg_opa(&style, LV_OBJ_PART_MAIN, LV_OPA_0);
-        lv_style_set_border_width(&style, LV_OBJ_PART_MAIN, 0);
-        lv_style_set_text_color(&style, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
-        lv_style_set_image_recolor(&style, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        static bool styled = false;
+        if (!styled) {
+            int arena = lvmem_arena_suspend();
+            lv_style_init(&plStyle);
+            lv_style_set_radius(&plStyle, LV_OBJ_PART_MAIN, 0);
+            lv_style_set_bg_color(&plStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
+            lv_style_set_bg_opa(&plStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
+            lv_style_set_border_width(&plStyle, LV_OBJ_PART_MAIN, 0);
+            lv_style_set_text_color(&plStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+            lv_style_set_image_recolor(&plStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+
+            lv_style_init(&style);
+            lv_style_set_radius(&style, LV_OBJ_PART_MAIN, 0);
+            lv_style_set_bg_color(&style, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
+            lv_style_set_bg_opa(&style, LV_OBJ_PART_MAIN, LV_OPA_0);
+            lv_style_set_border_width(&style, LV_OBJ_PART_MAIN, 0);
+            lv_style_set_text_color(&style, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+            lv_style_set_image_recolor(&style, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+            lvmem_arena_resume(arena);
+            styled = true;
+        }
 
         _preloadCont = lv_cont_create(parent, NULL);
         lv_obj_set_size(_preloadCont, LV_HOR_RES, LV_VER_RES - 30);
@@ -866,13 +1051,19 @@ void List::create(lv_obj_t *parent)
     }
     if (_listCont == nullptr) {
         static lv_style_t listStyle;
-        lv_style_init(&listStyle);
-        lv_style_set_radius(&listStyle, LV_OBJ_PART_MAIN, 0);
-        lv_style_set_bg_color(&listStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
-        lv_style_set_bg_opa(&listStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
-        lv_style_set_border_width(&listStyle, LV_OBJ_PART_MAIN, 0);
-        lv_style_set_text_color(&listStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
-        lv_style_set_image_recolor(&listStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        static bool styled = false;
+        if (!styled) {
+            int arena = lvmem_arena_suspend();
+            lv_style_init(&listStyle);
+            lv_style_set_radius(&listStyle, LV_OBJ_PART_MAIN, 0);
+            lv_style_set_bg_color(&listStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
+            lv_style_set_bg_opa(&listStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
+            lv_style_set_border_width(&listStyle, LV_OBJ_PART_MAIN, 0);
+            lv_style_set_text_color(&listStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+            lv_style_set_image_recolor(&listStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+            lvmem_arena_resume(arena);
+            styled = true;
+        }
 
         _listCont = lv_list_create(lv_scr_act(), NULL);
         lv_list_set_scrollbar_mode(_listCont, LV_SCROLLBAR_MODE_OFF);
@@ -898,6 +1089,25 @@ void List::align(const lv_obj_t *base, lv_align_t align, lv_coord_t x, lv_coord_
 void List::hidden(bool en)
 {
     lv_obj_set_hidden(_listCont, en);
+    if (!en) _list = this;
+}
+
+void List::clear()
+{
+    lv_list_clean(_listCont);
+}
+
+//! Hold the column layout while adding many buttons, endUpdate() lays them out once
+void List::beginUpdate()
+{
+    lv_obj_t *scrl = lv_page_get_scrollable(_listCont);
+    _layout = lv_cont_get_layout(scrl);
+    lv_cont_set_layout(scrl, LV_LAYOUT_OFF);
+}
+
+void List::endUpdate()
+{
+    lv_cont_set_layout(lv_page_get_scrollable(_listCont), _layout);
 }
 
 void List::__list_event_cb(lv_obj_t *obj, lv_event_t event)
@@ -992,6 +1202,78 @@ void MBox::setBtn(const char **btns)
     lv_msgbox_add_btns(_mbox, btns);
 }
 
+/*****************************************************************
+ *
+ *          ! Object pools
+ *
+ */
+static ObjectPool<MBox, 4> mboxPool("MBox");
+static ObjectPool<Switch, 2> switchPool("Switch");
+static ObjectPool<Keyboard, 1> keyboardPool("Keyboard");
+static ObjectPool<Preload, 2> preloadPool("Preload");
+static ObjectPool<List, 2> listPool("List");
+static ObjectPool<Task, 2> taskPool("Task");
+
+void *MBox::operator new(size_t size)
+{
+    return mboxPool.alloc(size);
+}
+
+void MBox::operator delete(void *p)
+{
+    mboxPool.free(p);
+}
+
+void *Switch::operator new(size_t size)
+{
+    return switchPool.alloc(size);
+}
+
+void Switch::operator delete(void *p)
+{
+    switchPool.free(p);
+}
+
+void *Keyboard::operator new(size_t size)
+{
+    return keyboardPool.alloc(size);
+}
+
+void Keyboard::operator delete(void *p)
+{
+    keyboardPool.free(p);
+}
+
+void *Preload::operator new(size_t size)
+{
+    return preloadPool.alloc(size);
+}
+
+void Preload::operator delete(void *p)
+{
+    preloadPool.free(p);
+}
+
+void *List::operator new(size_t size)
+{
+    return listPool.alloc(size);
+}
+
+void List::operator delete(void *p)
+{
+    listPool.free(p);
+}
+
+void *Task::operator new(size_t size)
+{
+    return taskPool.alloc(size);
+}
+
+void Task::operator delete(void *p)
+{
+    taskPool.free(p);
+}
+
 /*****************************************************************
  *
  *          ! GLOBAL VALUE
@@ -1004,9 +1286,131 @@ static List *list = nullptr;
 static Task *task = nullptr;
 static Ticker *gTicker = nullptr;
 static MBox *mbox = nullptr;
+static ScreenStack *screens = ScreenStack::getScreenStack();
 
 static char ssid[64], password[64];
 
+void wifi_sw_event_cb(uint8_t index, bool en);
+void wifi_list_cb(const char *txt);
+void wifi_kb_event_cb(Keyboard::kb_event_t event);
+
+/*****************************************************************
+ *
+ *          !WIFI SCREENS
+ *
+ */
+static void wifi_sw_create()
+{
+    Switch::switch_cfg_t cfg[3] = {{"Switch", wifi_sw_event_cb}, {"Scan", wifi_sw_event_cb}, {"NTP Sync", wifi_sw_event_cb}};
+    sw = new Switch;
+    sw->create(cfg, 3, []() {
+        screens->pop();
+        menuBars.hidden(false);
+    });
+    sw->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
+}
+
+static void wifi_sw_show()
+{
+    sw->setStatus(0, WiFi.isConnected());
+    sw->hidden(false);
+}
+
+static void wifi_sw_hide()
+{
+    sw->hidden();
+}
+
+static void wifi_sw_destroy()
+{
+    delete sw;
+    sw = nullptr;
+}
+
+static void wifi_pl_create()
+{
+    pl = new Preload;
+    pl->create();
+    pl->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
+}
+
+static void wifi_pl_show()
+{
+    pl->hidden(false);
+}
+
+static void wifi_pl_hide()
+{
+    pl->hidden();
+}
+
+static void wifi_pl_destroy()
+{
+    delete pl;
+    pl = nullptr;
+}
+
+static void wifi_list_create()
+{
+    list = new List;
+    list->create();
+    list->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
+    list->setListCb(wifi_list_cb);
+}
+
+static void wifi_list_show()
+{
+    list->clear();
+    list->beginUpdate();
+    for (int i = 0; i < wifi_scan_count(); i++) {
+        const wifi_scan_result_t *r = wifi_scan_get(i);
+        list->add(r->ssid, (void *)(r->known ? LV_SYMBOL_OK : LV_SYMBOL_WIFI));
+    }
+    list->endUpdate();
+    list->hidden(false);
+}
+
+static void wifi_list_hide()
+{
+    list->hidden();
+}
+
+static void wifi_list_destroy()
+{
+    delete list;
+    list = nullptr;
+}
+
+static void wifi_kb_create()
+{
+    kb = new Keyboard;
+    kb->create();
+    kb->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
+    kb->setKeyboardEvent(wifi_kb_event_cb);
+}
+
+static void wifi_kb_show()
+{
+    kb->clear();
+    kb->hidden(false);
+}
+
+static void wifi_kb_hide()
+{
+    kb->hidden();
+}
+
+static void wifi_kb_destroy()
+{
+    delete kb;
+    kb = nullptr;
+}
+
+static ScreenStack::screen_t wifiSwScreen = {"WiFi", wifi_sw_create, wifi_sw_show, wifi_sw_hide, wifi_sw_destroy};
+static ScreenStack::screen_t wifiPlScreen = {"Preload", wifi_pl_create, wifi_pl_show, wifi_pl_hide, wifi_pl_destroy};
+static ScreenStack::screen_t wifiListScreen = {"WiFi list", wifi_list_create, wifi_list_show, wifi_list_hide, wifi_list_destroy};
+static ScreenStack::screen_t wifiKbScreen = {"Keyboard", wifi_kb_create, wifi_kb_show, wifi_kb_hide, wifi_kb_destroy};
+
 /*****************************************************************
  *
  *          !WIFI EVENT
@@ -1018,22 +1422,12 @@ void wifi_connect_status(bool result)
         delete gTicker;
         gTicker = nullptr;
     }
-    if (kb != nullptr) {
-        delete kb;
-        kb = nullptr;
-    }
-    if (sw != nullptr) {
-        delete sw;
-        sw = nullptr;
-    }
-    if (pl != nullptr) {
-        delete pl;
-        pl = nullptr;
-    }
+    screens->clear();
     if (result) {
         bar.show(LV_STATUS_BAR_WIFI);
     } else {
         bar.hidden(LV_STATUS_BAR_WIFI);
+        radio_release(RADIO_CLIENT_USER);
     }
     menuBars.hidden(false);
 }
@@ -1041,77 +1435,86 @@ void wifi_connect_status(bool result)
 void wifi_kb_event_cb(Keyboard::kb_event_t event)
 {
     if (event == 0) {
-        kb->hidden();
         Serial.println(kb->getText());
         strlcpy(password, kb->getText(), sizeof(password));
-        pl->hidden(false);
-        WiFi.mode(WIFI_STA);
-        WiFi.disconnect();
-        WiFi.begin(ssid, password);
+        screens->replace(&wifiPlScreen);
+        radio_acquire(RADIO_CLIENT_USER);
+        wifi_connect(ssid, password);
         gTicker = new Ticker;
         gTicker->once_ms(5 * 1000, []() {
             wifi_connect_status(false);
         });
     } else if (event == 1) {
-        delete kb;
-        delete sw;
-        delete pl;
-        pl = nullptr;
-        kb = nullptr;
-        sw = nullptr;
+        screens->clear();
         menuBars.hidden(false);
     }
 }
 
-static void wifi_sync_mbox_cb(lv_task_t *t)
+static void wifi_ntp_poll_cb(lv_task_t *t)
 {
-    static  struct tm timeinfo;
-    bool ret = false;
-    static int retry = 0;
-    configTzTime(RTC_TIME_ZONE, "pool.ntp.org");
-    while (1) {
-        ret = getLocalTime(&timeinfo);
-        if (!ret) {
-            Serial.printf("get ntp fail,retry : %d \n", retry++);
-        } else {
-            //! del preload
-            delete pl;
-            pl = nullptr;
-
-            char format[256];
-            snprintf(format, sizeof(format), "Time acquisition is:%d-%d-%d/%d:%d:%d, Whether to synchronize?", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
-            Serial.println(format);
-            delete task;
-            task = nullptr;
-
-            //! mbox
-            static const char *btns[] = {"Ok", "Cancle", ""};
-            mbox = new MBox;
-            mbox->create(format, [](lv_obj_t *obj, lv_event_t event) {
-                if (event == LV_EVENT_VALUE_CHANGED) {
-                    const char *txt =  lv_msgbox_get_active_btn_text(obj);
-                    if (!strcmp(txt, "Ok")) {
-
-                        //!sync to rtc
-                        struct tm *info =  (struct tm *)mbox->getData();
-                        Serial.printf("read use data = %d:%d:%d - %d:%d:%d \n", info->tm_year + 1900, info->tm_mon + 1, info->tm_mday, info->tm_hour, info->tm_min, info->tm_sec);
-
-                        TTGOClass *ttgo = TTGOClass::getWatch();
-                        ttgo->rtc->setDateTime(info->tm_year + 1900, info->tm_mon + 1, info->tm_mday, info->tm_hour, info->tm_min, info->tm_sec);
-                    } else if (!strcmp(txt, "Cancle")) {
-                        //!cancle
-                        // Serial.println("Cancle press");
-                    }
-                    delete mbox;
-                    mbox = nullptr;
-                    sw->hidden(false);
-                }
-            });
-            mbox->setBtn(btns);
-            mbox->setData(&timeinfo);
-            return;
-        }
+    NtpClient::getNtpClient()->poll();
+}
+
+static void wifi_ntp_done_cb(bool ok, int64_t offsetUs)
+{
+    delete task;
+    task = nullptr;
+    radio_release(RADIO_CLIENT_NTP);
+    //! keep the preload on the stack until the mbox is closed
+    pl->hidden();
+
+    char format[256];
+    if (!ok) {
+        snprintf(format, sizeof(format), "NTP sync failed after %d attempts", NtpClient::getNtpClient()->attempts());
+        Serial.println(format);
+        mbox = new MBox;
+        mbox->create(format, [](lv_obj_t *obj, lv_event_t event) {
+            if (event == LV_EVENT_VALUE_CHANGED) {
+                delete mbox;
+                mbox = nullptr;
+                screens->pop();
+            }
+        });
+        return;
     }
+
+    //! Step the system clock by the measured offset, the RTC is only written if the user agrees
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t nowUs = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec + offsetUs;
+    Serial.printf("NTP offset %lld ms\n", offsetUs / 1000);
+    timekeeper_reference(nowUs, TIMEKEEPER_NTP_RESOLUTION_MS, false);
+    setenv("TZ", RTC_TIME_ZONE, 1);
+    tzset();
+    //! The system clock now holds UTC, stored event times are off by the zone offset
+    schedule_clock_changed();
+
+    struct tm timeinfo;
+    time_t now = nowUs / 1000000;
+    localtime_r(&now, &timeinfo);
+    snprintf(format, sizeof(format), "Time acquisition is:%d-%d-%d/%d:%d:%d, Whether to synchronize?", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+    Serial.println(format);
+
+    //! mbox
+    static const char *btns[] = {"Ok", "Cancle", ""};
+    mbox = new MBox;
+    mbox->create(format, [](lv_obj_t *obj, lv_event_t event) {
+        if (event == LV_EVENT_VALUE_CHANGED) {
+            const char *txt =  lv_msgbox_get_active_btn_text(obj);
+            if (!strcmp(txt, "Ok")) {
+
+                //!sync to rtc, from the corrected clock rather than the stale prompt time
+                timekeeper_write_rtc();
+            } else if (!strcmp(txt, "Cancle")) {
+                //!cancle
+                // Serial.println("Cancle press");
+            }
+            delete mbox;
+            mbox = nullptr;
+            screens->pop();
+        }
+    });
+    mbox->setBtn(btns);
 }
 
 void wifi_sw_event_cb(uint8_t index, bool en)
@@ -1119,17 +1522,21 @@ void wifi_sw_event_cb(uint8_t index, bool en)
     switch (index) {
     case 0:
         if (en) {
-            WiFi.begin();
+            radio_acquire(RADIO_CLIENT_USER);
+            wifi_connect(nullptr, nullptr);
         } else {
             WiFi.disconnect();
+            radio_release(RADIO_CLIENT_USER);
             bar.hidden(LV_STATUS_BAR_WIFI);
         }
         break;
     case 1:
-        sw->hidden();
-        pl = new Preload;
-        pl->create();
-        pl->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
+        if (wifi_scan_fresh()) {
+            screens->push(&wifiListScreen);
+            break;
+        }
+        screens->push(&wifiPlScreen);
+        radio_acquire(RADIO_CLIENT_SCAN);
         WiFi.disconnect();
         WiFi.scanNetworks(true);
         break;
@@ -1144,11 +1551,10 @@ void wifi_sw_event_cb(uint8_t index, bool en)
                 return;
             }
             task = new Task;
-            task->create(wifi_sync_mbox_cb);
-            sw->hidden();
-            pl = new Preload;
-            pl->create();
-            pl->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
+            task->create(wifi_ntp_poll_cb, 50);
+            screens->push(&wifiPlScreen);
+            radio_acquire(RADIO_CLIENT_NTP);
+            NtpClient::getNtpClient()->begin(wifi_ntp_done_cb);
         }
         break;
     default:
@@ -1159,91 +1565,22 @@ void wifi_sw_event_cb(uint8_t index, bool en)
 void wifi_list_cb(const char *txt)
 {
     strlcpy(ssid, txt, sizeof(ssid));
-    delete list;
-    list = nullptr;
-    kb = new Keyboard;
-    kb->create();
-    kb->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
-    kb->setKeyboardEvent(wifi_kb_event_cb);
+    screens->replace(&wifiKbScreen);
 }
 
-void wifi_list_add(const char *ssid)
+void wifi_scan_done()
 {
-    if (list == nullptr) {
-        pl->hidden();
-        list = new List;
-        list->create();
-        list->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
-        list->setListCb(wifi_list_cb);
+    wifi_scan_collect();
+    radio_release(RADIO_CLIENT_SCAN);
+    if (screens->top() == &wifiPlScreen) {
+        screens->replace(&wifiListScreen);
     }
-    list->add(ssid);
+    //! A scan that finished after the WiFi screens were closed is kept for next time
 }
 
 static void wifi_event_cb()
 {
-    Switch::switch_cfg_t cfg[3] = {{"Switch", wifi_sw_event_cb}, {"Scan", wifi_sw_event_cb}, {"NTP Sync", wifi_sw_event_cb}};
-    sw = new Switch;
-    sw->create(cfg, 3, []() {
-        delete sw;
-        sw = nullptr;
-        menuBars.hidden(false);
-    });
-    sw->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
-    sw->setStatus(0, WiFi.isConnected());
-}
-
-static void wifi_destory()
-{
-    Serial.printf("globalIndex:%d\n", globalIndex);
-    switch (globalIndex) {
-    //! wifi management main
-    case 0:
-        menuBars.hidden(false);
-        delete sw;
-        sw = nullptr;
-        break;
-    //! wifi ap list
-    case 1:
-        if (list != nullptr) {
-            delete list;
-            list = nullptr;
-        }
-        if (gTicker != nullptr) {
-            delete gTicker;
-            gTicker = nullptr;
-        }
-        if (kb != nullptr) {
-            delete kb;
-            kb = nullptr;
-        }
-        if (pl != nullptr) {
-            delete pl;
-            pl = nullptr;
-        }
-        sw->hidden(false);
-        break;
-    //! wifi keyboard
-    case 2:
-        if (gTicker != nullptr) {
-            delete gTicker;
-            gTicker = nullptr;
-        }
-        if (kb != nullptr) {
-            delete kb;
-            kb = nullptr;
-        }
-        if (pl != nullptr) {
-            delete pl;
-            pl = nullptr;
-        }
-        sw->hidden(false);
-        break;
-    case 3:
-        break;
-    default:
-        break;
-    }
-    globalIndex--;
+    screens->push(&wifiSwScreen);
 }
 
 /*****************************************************************
@@ -1275,18 +1612,19 @@ static void light_event_cb()
         {"light3", light_sw_event_cb},
         {"light4", light_sw_event_cb},
     };
-    sw = new Switch;
-    sw->create(cfg, cfg_count, []() {
-        delete sw;
-        sw = nullptr;
+    static Switch *lightSw = nullptr;
+    lightSw = new Switch;
+    lightSw->create(cfg, cfg_count, []() {
+        delete lightSw;
+        lightSw = nullptr;
         menuBars.hidden(false);
     });
 
-    sw->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
+    lightSw->align(bar.self(), LV_ALIGN_OUT_BOTTOM_MID);
 
     //Initialize switch status
     for (int i = 0; i < cfg_count; i++) {
-        sw->setStatus(i, 0);
+        lightSw->setStatus(i, 0);
     }
 }
 
@@ -1311,14 +1649,7 @@ static void create_mbox(const char *txt, lv_event_cb_t event_cb)
 
 static void destory_mbox()
 {
-    if (pl != nullptr) {
-        delete pl;
-        pl = nullptr;
-    }
-    if (list != nullptr) {
-        delete list;
-        list = nullptr;
-    }
+    screens->clear();
     if (mbox1 != nullptr) {
         lv_obj_del(mbox1);
         mbox1 = nullptr;
@@ -0,0 +1,270 @@
+#include "config.h"
+#include <Arduino.h>
+#include "esp_heap_caps.h"
+#include "lvmem.h"
+
+enum {
+    REGION_INTERNAL,
+    REGION_PSRAM,
+    REGION_ARENA,
+    REGION_COUNT
+};
+
+//! Every block carries its size and region so free/realloc need no lookup
+#define HDR_SIZE            sizeof(uint32_t)
+#define HDR_REGION_SHIFT    30
+#define HDR_SIZE_MASK       ((1UL << HDR_REGION_SHIFT) - 1)
+#define HIST_BUCKETS        14
+
+typedef struct {
+    uint8_t *base;
+    uint32_t used;
+    uint32_t peak;
+    uint32_t live;
+    uint32_t liveBytes;
+    uint32_t releases;
+    const char *name;
+    bool busy;
+    bool released;
+} arena_t;
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t peak;
+    uint32_t blocks;
+} region_stat_t;
+
+static arena_t arenas[LVMEM_ARENA_COUNT];
+static int activeArena = LVMEM_NO_ARENA;
+static region_stat_t regions[REGION_COUNT];
+static uint32_t histogram[HIST_BUCKETS];
+static uint32_t arenaOverflows = 0;
+static uint32_t deferredReleases = 0;
+static uint32_t zeroMem;
+
+static const char *regionNames[REGION_COUNT] = {"internal", "psram", "arena"};
+
+static uint8_t bucket(size_t size)
+{
+    uint8_t b = 0;
+    while ((8U << b) < size && b < HIST_BUCKETS - 1) {
+        b++;
+    }
+    return b;
+}
+
+static void account(uint8_t region, int32_t bytes)
+{
+    region_stat_t *r = &regions[region];
+    r->bytes += bytes;
+    r->blocks += bytes > 0 ? 1 : -1;
+    if (r->bytes > r->peak) r->peak = r->bytes;
+}
+
+static uint32_t *arena_alloc(size_t total)
+{
+    arena_t *a = &arenas[activeArena];
+    size_t size = total - HDR_SIZE;
+    total = (total + 3) & ~3;
+    if (a->used + total > LVMEM_ARENA_SIZE) {
+        arenaOverflows++;
+        return nullptr;
+    }
+    uint32_t *hdr = (uint32_t *)(a->base + a->used);
+    a->used += total;
+    a->live++;
+    a->liveBytes += size;
+    if (a->used > a->peak) a->peak = a->used;
+    return hdr;
+}
+
+static bool in_arena(const void *p, int *index)
+{
+    for (int i = 0; i < LVMEM_ARENA_COUNT; i++) {
+        uint8_t *base = arenas[i].base;
+        if (base != nullptr && (uint8_t *)p >= base && (uint8_t *)p < base + LVMEM_ARENA_SIZE) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *block_alloc(size_t size)
+{
+    size_t total = size + HDR_SIZE;
+    uint32_t *hdr = nullptr;
+    uint8_t region = REGION_INTERNAL;
+
+    if (activeArena != LVMEM_NO_ARENA) {
+        hdr = arena_alloc(total);
+        region = REGION_ARENA;
+    }
+    if (hdr == nullptr && size >= LVMEM_PSRAM_THRESHOLD && psramFound()) {
+        hdr = (uint32_t *)heap_caps_malloc(total, MALLOC_CAP_SPIRAM);
+        region = REGION_PSRAM;
+    }
+    if (hdr == nullptr) {
+        hdr = (uint32_t *)heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        region = REGION_INTERNAL;
+    }
+    if (hdr == nullptr) return nullptr;
+
+    *hdr = size | ((uint32_t)region << HDR_REGION_SHIFT);
+    account(region, size);
+    histogram[bucket(size)]++;
+    return hdr + 1;
+}
+
+static void arena_reset(arena_t *a)
+{
+    a->used = 0;
+    a->busy = false;
+    a->released = false;
+    a->releases++;
+}
+
+static void block_free(const void *data)
+{
+    uint32_t *hdr = (uint32_t *)data - 1;
+    uint8_t region = *hdr >> HDR_REGION_SHIFT;
+    account(region, -(int32_t)(*hdr & HDR_SIZE_MASK));
+    if (region == REGION_ARENA) {
+        int i;
+        if (in_arena(hdr, &i) && arenas[i].live > 0) {
+            arena_t *a = &arenas[i];
+            a->live--;
+            a->liveBytes -= *hdr & HDR_SIZE_MASK;
+            if (a->released && a->live == 0) {
+                arena_reset(a);
+            }
+        }
+        return;
+    }
+    heap_caps_free(hdr);
+}
+
+extern "C" {
+
+void *__wrap_lv_mem_alloc(size_t size)
+{
+    if (size == 0) return &zeroMem;
+    return block_alloc(size);
+}
+
+void __wrap_lv_mem_free(const void *data)
+{
+    if (data == nullptr || data == &zeroMem) return;
+    block_free(data);
+}
+
+void *__wrap_lv_mem_realloc(void *data_p, size_t new_size)
+{
+    if (data_p == nullptr || data_p == &zeroMem) {
+        return __wrap_lv_mem_alloc(new_size);
+    }
+    if (new_size == 0) {
+        block_free(data_p);
+        return &zeroMem;
+    }
+    uint32_t old_size = *((uint32_t *)data_p - 1) & HDR_SIZE_MASK;
+    if (new_size <= old_size) return data_p;
+
+    void *p = block_alloc(new_size);
+    if (p == nullptr) return nullptr;
+    memcpy(p, data_p, old_size);
+    block_free(data_p);
+    return p;
+}
+
+}
+
+int lvmem_arena_begin(const char *name)
+{
+    if (!psramFound()) return LVMEM_NO_ARENA;
+    for (int i = 0; i < LVMEM_ARENA_COUNT; i++) {
+        arena_t *a = &arenas[i];
+        if (a->busy) continue;
+        if (a->base == nullptr) {
+            a->base = (uint8_t *)heap_caps_malloc(LVMEM_ARENA_SIZE, MALLOC_CAP_SPIRAM);
+            if (a->base == nullptr) return LVMEM_NO_ARENA;
+        }
+        a->busy = true;
+        a->released = false;
+        a->name = name;
+        a->used = 0;
+        a->live = 0;
+        a->liveBytes = 0;
+        activeArena = i;
+        return i;
+    }
+    return LVMEM_NO_ARENA;
+}
+
+void lvmem_arena_end()
+{
+    activeArena = LVMEM_NO_ARENA;
+}
+
+void lvmem_arena_release(int arena)
+{
+    if (arena < 0 || arena >= LVMEM_ARENA_COUNT) return;
+    arena_t *a = &arenas[arena];
+    if (!a->busy || a->released) return;
+    if (activeArena == arena) {
+        activeArena = LVMEM_NO_ARENA;
+    }
+    if (a->live > 0) {
+        //! Something built in the arena is still in use, reusing it now
+        //! would hand that memory out twice. The last free resets it.
+        a->released = true;
+        deferredReleases++;
+        Serial.printf("LVGL memory: arena %s released with %u blocks live, %u bytes\n",
+                      a->name, a->live, a->liveBytes);
+        return;
+    }
+    arena_reset(a);
+}
+
+int lvmem_arena_suspend()
+{
+    int arena = activeArena;
+    activeArena = LVMEM_NO_ARENA;
+    return arena;
+}
+
+void lvmem_arena_resume(int arena)
+{
+    activeArena = arena;
+}
+
+uint32_t lvmem_used()
+{
+    uint32_t used = 0;
+    for (int i = 0; i < REGION_COUNT; i++) {
+        used += regions[i].bytes;
+    }
+    return used;
+}
+
+void lvmem_report()
+{
+    Serial.println("LVGL memory:");
+    for (int i = 0; i < REGION_COUNT; i++) {
+        Serial.printf("  %-8s %7u bytes in %4u blocks, peak %7u\n", regionNames[i],
+                      regions[i].bytes, regions[i].blocks, regions[i].peak);
+    }
+    for (int i = 0; i < LVMEM_ARENA_COUNT; i++) {
+        arena_t *a = &arenas[i];
+        if (a->base == nullptr) continue;
+        Serial.printf("  arena %d %-10s %5u/%u used, peak %5u, %u live, %u releases\n", i,
+                      !a->busy ? "(free)" : a->released ? "(draining)" : a->name,
+                      a->used, LVMEM_ARENA_SIZE, a->peak, a->live, a->releases);
+    }
+    Serial.printf("  arena overflows %u, releases deferred for live blocks %u\n", arenaOverflows, deferredReleases);
+    Serial.print("  sizes:");
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        Serial.printf(" <=%u:%u", 8U << i, histogram[i]);
+    }
+    Serial.println();
+}
@@ -20,6 +20,31 @@ Created by Lewis he on October 10, 2019.
 #include <WiFi.h>
 #include "gui.h"
 #include "ble.h"
+#include "blend.h"
+#include "pool.h"
+#include "touch.h"
+#include "profiler.h"
+#include "screen.h"
+#include "lvmem.h"
+#include "timekeeper.h"
+#include "wificache.h"
+#include "wifiscan.h"
+#include "radio.h"
+#include "boot.h"
+#include "steps.h"
+#include "activity.h"
+#include "wake.h"
+#include "gadgetbridge.h"
+#include "bletx.h"
+#include "blerx.h"
+#include "call.h"
+#include "music.h"
+#include "weather.h"
+#include "schedule.h"
+#include "notifyview.h"
+#include "fonts.h"
+#include "assets.h"
+#include <SPIFFS.h>
 
 
 enum {
@@ -41,11 +66,21 @@ EventGroupHandle_t* get_isr_group() {
 
 void setupNetwork()
 {
-    WiFi.mode(WIFI_STA);
+    //! The radio stays off until radio_acquire()
+    setupWifiCache();
     WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
         xEventGroupClearBits(g_event_group, G_EVENT_WIFI_CONNECTED);
+        wifi_cache_disconnected(info.disconnected.reason);
     }, WiFiEvent_t::SYSTEM_EVENT_STA_DISCONNECTED);
 
+    WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+        wifi_cache_radio(event == SYSTEM_EVENT_STA_START);
+    }, WiFiEvent_t::SYSTEM_EVENT_STA_START);
+
+    WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
+        wifi_cache_radio(event == SYSTEM_EVENT_STA_START);
+    }, WiFiEvent_t::SYSTEM_EVENT_STA_STOP);
+
     WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
         uint8_t data = Q_EVENT_WIFI_SCAN_DONE;
         xQueueSend(g_event_queue_handle, &data, portMAX_DELAY);
@@ -56,7 +91,8 @@ void setupNetwork()
     }, WiFiEvent_t::SYSTEM_EVENT_STA_CONNECTED);
 
     WiFi.onEvent([](WiFiEvent_t event, WiFiEventInfo_t info) {
-        wifi_connect_status(true);
+        //! Probing a reused address would block the event task, loop() does it
+        wifi_cache_got_ip();
     }, WiFiEvent_t::SYSTEM_EVENT_STA_GOT_IP);
 }
 
@@ -67,12 +103,12 @@ void low_energy()
     if (ttgo->bl->isOn()) {
         xEventGroupSetBits(isr_group, WATCH_FLAG_SLEEP_MODE);
         ttgo->closeBL();
+        wake_sleeping();
         ttgo->stopLvglTick();
-        ttgo->bma->enableStepCountInterrupt(false);
         ttgo->displaySleep();
         if (!WiFi.isConnected()) {
             lenergy = true;
-            WiFi.mode(WIFI_OFF);
+            radio_shutdown();
             // rtc_clk_cpu_freq_set(RTC_CPU_FREQ_2M);
             // 80 MHZ is the minimum clock speed for keeping bluetooth working
             setCpuFrequencyMhz(80);
@@ -81,19 +117,96 @@ void low_energy()
     } else {
         ttgo->startLvglTick();
         ttgo->displayWakeup();
-        ttgo->rtc->syncToSystem();
-        // updateStepCounter(ttgo->bma->getCounter());
+        timekeeper_wake();
+        steps_publish();
         updateBatteryLevel();
         updateBatteryIcon(LV_ICON_CALCULATION);
         lv_disp_trig_activity(NULL);
         ttgo->openBL();
-        // ttgo->bma->enableStepCountInterrupt();
+        wake_shown();
+    }
+}
+
+static void run_command(const char *cmd)
+{
+    if (!strcmp(cmd, "stats")) {
+        profiler_dump();
+        touch_report();
+        lvmem_report();
+        PoolBase::report("now");
+        ScreenStack::getScreenStack()->report();
+        boot_report();
+        timekeeper_report();
+        steps_report();
+        activity_report();
+        wake_report();
+        gadgetbridge_report();
+        music_report();
+        weather_report();
+        schedule_report();
+        notify_view_report();
+        fonts_report();
+        assets_report();
+        radio_report();
+        wifi_cache_report();
+        wifi_scan_report();
+    } else if (!strcmp(cmd, "frames")) {
+        profiler_dump();
+    } else if (!strcmp(cmd, "reset")) {
+        profiler_reset();
+    } else if (!strcmp(cmd, "menubench")) {
+        MenuBar::bench(4);
+        MenuBar::bench(MENU_BENCH_ENTRIES);
+    } else {
+        Serial.println("Commands: stats, frames, reset, menubench");
     }
 }
 
+//! Line based commands on the serial console
+static void serial_command()
+{
+    static char line[32];
+    static uint8_t len = 0;
+    while (Serial.available()) {
+        char c = Serial.read();
+        if (c == '\r' || c == '\n') {
+            line[len] = '\0';
+            if (len) {
+                run_command(line);
+            }
+            len = 0;
+        } else if (len < sizeof(line) - 1) {
+            line[len++] = c;
+        }
+    }
+}
+
+//! Everything the clock face does not need, started after it is on screen
+static void deferred_setup(void *arg)
+{
+    //Mount the data partition, formats it on first boot
+    SPIFFS.begin(true);
+    activity_storage_ready();
+    fonts_load_pack();
+    boot_stage("storage");
+
+    //Setting up the network
+    setupNetwork();
+    boot_stage("network");
+
+    //Set up BLE, outgoing messages have their own task
+    setupRx();
+    setupBle();
+    setupTx();
+    boot_connectable();
+
+    vTaskDelete(NULL);
+}
+
 void setup()
 {
     Serial.begin(115200);
+    boot_stage("serial");
 
     //Create a program that allows the required message objects and group flags
     g_event_queue_handle = xQueueCreate(20, sizeof(uint8_t));
@@ -105,6 +218,7 @@ void setup()
 
     //Initialize TWatch
     ttgo->begin();
+    boot_stage("watch");
 
     // Turn on the IRQ used
     ttgo->power->adc1Enable(AXP202_BATT_VOL_ADC1 | AXP202_BATT_CUR_ADC1 | AXP202_VBUS_VOL_ADC1 | AXP202_VBUS_CUR_ADC1, AXP202_ON);
@@ -119,38 +233,45 @@ void setup()
 
     //Initialize lvgl
     ttgo->lvgl_begin();
+    boot_stage("lvgl");
+
+    //Use the RGB565 kernels for LVGL fills and image blends
+    setupBlend();
+
+    //Only talk to the touch controller after it raises TOUCH_INT
+    setupTouch();
 
     //Initialize motor
     ttgo->motor_begin();
 
-    //BMA423 disabled for now
+    //Step counting on the BMA423, batched by the step counter watermark
+    setupSteps();
+    setupActivity();
 
-    //Initialize bma423
-    // ttgo->bma->begin();
-
-    //Enable BMA423 interrupt
-    // ttgo->bma->attachInterrupt();
+    //Wrist tilt and double tap wake the screen
+    setupWake();
 
     //Connection interrupted to the specified pin
-    // pinMode(BMA423_INT1, INPUT);
-    // attachInterrupt(BMA423_INT1, [] {
-    //     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    //     EventBits_t  bits = xEventGroupGetBitsFromISR(isr_group);
-    //     if (bits & WATCH_FLAG_SLEEP_MODE)
-    //     {
-    //         //! For quick wake up, use the group flag
-    //         xEventGroupSetBitsFromISR(isr_group, WATCH_FLAG_SLEEP_EXIT | WATCH_FLAG_BMA_IRQ, &xHigherPriorityTaskWoken);
-    //     } else
-    //     {
-    //         uint8_t data = Q_EVENT_BMA_INT;
-    //         xQueueSendFromISR(g_event_queue_handle, &data, &xHigherPriorityTaskWoken);
-    //     }
-
-    //     if (xHigherPriorityTaskWoken)
-    //     {
-    //         portYIELD_FROM_ISR ();
-    //     }
-    // }, RISING);
+    pinMode(BMA423_INT1, INPUT);
+    attachInterrupt(BMA423_INT1, [] {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        EventBits_t  bits = xEventGroupGetBitsFromISR(isr_group);
+        if (bits & WATCH_FLAG_SLEEP_MODE)
+        {
+            //! Could be a wake gesture, loop() reads the cause before the display comes on
+            wake_mark();
+            xEventGroupSetBitsFromISR(isr_group, WATCH_FLAG_SLEEP_EXIT | WATCH_FLAG_BMA_IRQ, &xHigherPriorityTaskWoken);
+        } else
+        {
+            uint8_t data = Q_EVENT_BMA_INT;
+            xQueueSendFromISR(g_event_queue_handle, &data, &xHigherPriorityTaskWoken);
+        }
+
+        if (xHigherPriorityTaskWoken)
+        {
+            portYIELD_FROM_ISR ();
+        }
+    }, RISING);
 
     // Connection interrupted to the specified pin
     pinMode(AXP202_INT, INPUT);
@@ -175,8 +296,22 @@ void setup()
     //Check if the RTC clock matches, if not, use compile time
     ttgo->rtc->check();
 
-    //Synchronize time to system time
-    ttgo->rtc->syncToSystem();
+    //Synchronize time to system time, later wakes only correct it for drift
+    timekeeper_begin();
+
+    //Alarms and calendar events, the RTC alarm interrupt is the only timer for them
+    setupSchedule();
+    pinMode(RTC_INT_PIN, INPUT_PULLUP);
+    attachInterrupt(RTC_INT_PIN, [] {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        //! loop() decides whether anything is due before waking the screen
+        xEventGroupSetBitsFromISR(isr_group, WATCH_FLAG_RTC_IRQ, &xHigherPriorityTaskWoken);
+        if (xHigherPriorityTaskWoken)
+        {
+            portYIELD_FROM_ISR ();
+        }
+    }, FALLING);
+    boot_stage("rtc");
 
 #ifdef LILYGO_WATCH_HAS_BUTTON
 
@@ -194,14 +329,21 @@ void setup()
     });
 #endif
 
-    //Setting up the network
-    setupNetwork();
-
-    //Set up BLE
-    setupBle();
-
     //Execute your own GUI interface
+    setupAssets();
+    setupFonts();
     setupGui();
+    setupCall();
+    setupNotifyView();
+    setupMusic();
+    boot_stage("gui");
+
+    //Time lv_task_handler, its tasks and the display flush
+    setupProfiler();
+
+#if POOL_SOAK_TEST
+    pool_soak_test(1000);
+#endif
 
     //Clear lvgl counter
     lv_disp_trig_activity(NULL);
@@ -213,16 +355,32 @@ void setup()
     }, 30, 1, nullptr);
 #endif
 
-    //When the initialization is complete, turn on the backlight
+    //Draw the clock face before the backlight comes on, then turn it on
+    lv_refr_now(NULL);
     ttgo->openBL();
+    boot_first_frame();
+
+    //Network and BLE come up on the other core while the clock is already running
+    xTaskCreatePinnedToCore(deferred_setup, "boot", 8192, NULL, 1, NULL, BOOT_DEFERRED_CORE);
 }
 
 void loop()
 {
-    bool  rlst;
     uint8_t data;
+
+    serial_command();
+
     //! Fast response wake-up interrupt
     EventBits_t  bits = xEventGroupGetBits(isr_group);
+    if ((bits & WATCH_FLAG_SLEEP_EXIT) && (bits & WATCH_FLAG_BMA_IRQ)) {
+        xEventGroupClearBits(isr_group, WATCH_FLAG_BMA_IRQ);
+        bits &= ~WATCH_FLAG_BMA_IRQ;
+        if (!wake_classify() && !(bits & WATCH_FLAG_AXP_IRQ)) {
+            //! Only the step counter, stay asleep
+            xEventGroupClearBits(isr_group, WATCH_FLAG_SLEEP_EXIT);
+            bits &= ~WATCH_FLAG_SLEEP_EXIT;
+        }
+    }
     if (bits & WATCH_FLAG_SLEEP_EXIT) {
         if (lenergy) {
             lenergy = false;
@@ -234,12 +392,6 @@ void loop()
 
         low_energy();
 
-        if (bits & WATCH_FLAG_BMA_IRQ) {
-            do {
-                rlst =  ttgo->bma->readInterrupt();
-            } while (!rlst);
-            xEventGroupClearBits(isr_group, WATCH_FLAG_BMA_IRQ);
-        }
         if (bits & WATCH_FLAG_AXP_IRQ) {
             ttgo->power->readIRQ();
             ttgo->power->clearIRQ();
@@ -249,6 +401,21 @@ void loop()
         xEventGroupClearBits(isr_group, WATCH_FLAG_SLEEP_EXIT);
         xEventGroupClearBits(isr_group, WATCH_FLAG_SLEEP_MODE);
     }
+    if (bits & WATCH_FLAG_BMA_IRQ) {
+        xEventGroupClearBits(isr_group, WATCH_FLAG_BMA_IRQ);
+        steps_irq(!(bits & WATCH_FLAG_SLEEP_MODE));
+    }
+    if (bits & WATCH_FLAG_RTC_IRQ) {
+        xEventGroupClearBits(isr_group, WATCH_FLAG_RTC_IRQ);
+        schedule_irq();
+    }
+    //! Messages from the phone, a call may wake the screen
+    rx_poll();
+    activity_poll();
+    gadgetbridge_status_poll();
+    if (wifi_cache_poll()) {
+        wifi_connect_status(true);
+    }
     if ((bits & WATCH_FLAG_SLEEP_MODE)) {
         //! No event processing after entering the information screen
         return;
@@ -258,14 +425,7 @@ void loop()
     if (xQueueReceive(g_event_queue_handle, &data, 5 / portTICK_RATE_MS) == pdPASS) {
         switch (data) {
         case Q_EVENT_BMA_INT:
-            do {
-                rlst =  ttgo->bma->readInterrupt();
-            } while (!rlst);
-
-            //! setp counter
-            if (ttgo->bma->isStepCounter()) {
-                updateStepCounter(ttgo->bma->getCounter());
-            }
+            steps_irq(true);
             break;
         case Q_EVENT_AXP_INT:
             ttgo->power->readIRQ();
@@ -285,20 +445,19 @@ void loop()
             }
             ttgo->power->clearIRQ();
             break;
-        case Q_EVENT_WIFI_SCAN_DONE: {
-            int16_t len =  WiFi.scanComplete();
-            for (int i = 0; i < len; ++i) {
-                wifi_list_add(WiFi.SSID(i).c_str());
-            }
+        case Q_EVENT_WIFI_SCAN_DONE:
+            wifi_scan_done();
             break;
-        }
         default:
             break;
         }
 
     }
+    radio_poll();
     if (lv_disp_get_inactive_time(NULL) < DEFAULT_SCREEN_TIMEOUT) {
+        PROFILER_FRAME_BEGIN();
         lv_task_handler();
+        PROFILER_FRAME_END();
     } else {
         low_energy();
     }
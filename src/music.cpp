@@ -0,0 +1,259 @@
+#include "config.h"
+#include <Arduino.h>
+#include "gui.h"
+#include "screen.h"
+#include "bletx.h"
+#include "fonts.h"
+#include "lvmem.h"
+#include "music.h"
+
+typedef enum {
+    MUSIC_FIELD_ARTIST,
+    MUSIC_FIELD_ALBUM,
+    MUSIC_FIELD_TRACK,
+    MUSIC_FIELD_STATE,
+    MUSIC_FIELD_POSITION,
+    MUSIC_FIELDS,
+} music_field_t;
+
+static const char *const fieldNames[MUSIC_FIELDS] = {"artist", "album", "track", "state", "position"};
+
+//! Label text lives here, the labels use it with lv_label_set_text_static()
+static char artist[MUSIC_TEXT_SIZE];
+static char album[MUSIC_TEXT_SIZE];
+static char track[MUSIC_TEXT_SIZE];
+static char positionText[24];
+static bool playing = false;
+static int32_t duration = 0;
+static int32_t position = 0;
+static uint32_t positionMs = 0;
+static int32_t shownPosition = -1;
+
+static lv_obj_t *musicCont = nullptr;
+static lv_obj_t *artistLabel = nullptr;
+static lv_obj_t *albumLabel = nullptr;
+static lv_obj_t *trackLabel = nullptr;
+static lv_obj_t *progressBar = nullptr;
+static lv_obj_t *positionLabel = nullptr;
+static lv_obj_t *playLabel = nullptr;
+static lv_task_t *tickTask = nullptr;
+
+static uint32_t updates = 0;
+static uint32_t patches[MUSIC_FIELDS] = {0};
+static uint32_t unchanged = 0;
+static uint32_t commands = 0;
+
+static void send(const char *cmd)
+{
+    commands++;
+    tx_action("{\"t\":\"music\",\"n\":\"%s\"}", cmd);
+}
+
+//! Seconds into the track now, counting on locally while playing
+static int32_t current_position()
+{
+    int32_t p = position;
+    if (playing) p += (millis() - positionMs) / 1000;
+    if (duration > 0 && p > duration) p = duration;
+    return p;
+}
+
+static void patch_position()
+{
+    int32_t p = current_position();
+    if (p == shownPosition || progressBar == nullptr) return;
+    shownPosition = p;
+    patches[MUSIC_FIELD_POSITION]++;
+    lv_bar_set_range(progressBar, 0, duration > 0 ? duration : 1);
+    lv_bar_set_value(progressBar, duration > 0 ? p : 0, LV_ANIM_OFF);
+    snprintf(positionText, sizeof(positionText), "%d:%02d / %d:%02d", p / 60, p % 60, duration / 60, duration % 60);
+    lv_label_set_text_static(positionLabel, positionText);
+}
+
+static void patch_state()
+{
+    patches[MUSIC_FIELD_STATE]++;
+    if (playLabel != nullptr) {
+        lv_label_set_text_static(playLabel, playing ? LV_SYMBOL_PAUSE : LV_SYMBOL_PLAY);
+    }
+}
+
+//! Copy new text in and redraw its label, only if it changed
+static void patch_text(music_field_t field, char *text, lv_obj_t *label, const char *value)
+{
+    if (value == nullptr) value = "";
+    if (!strncmp(text, value, MUSIC_TEXT_SIZE - 1)) {
+        unchanged++;
+        return;
+    }
+    strlcpy(text, value, MUSIC_TEXT_SIZE);
+    patches[field]++;
+    if (label != nullptr) lv_label_set_text_static(label, text);
+}
+
+static void control_cb(lv_obj_t *obj, lv_event_t event)
+{
+    if (event != LV_EVENT_CLICKED) return;
+    const char *cmd = (const char *)lv_obj_get_user_data(obj);
+    if (cmd == nullptr) {
+        //! Play/pause, flipped right away rather than waiting for the phone
+        send(playing ? "pause" : "play");
+        music_set_state(playing ? "pause" : "play", current_position());
+    } else {
+        send(cmd);
+    }
+}
+
+static lv_obj_t *create_label(lv_coord_t y, const char *text)
+{
+    lv_obj_t *label = lv_label_create(musicCont, NULL);
+    lv_label_set_long_mode(label, LV_LABEL_LONG_DOT);
+    lv_obj_set_width(label, LV_HOR_RES - 20);
+    lv_label_set_align(label, LV_LABEL_ALIGN_CENTER);
+    lv_label_set_text_static(label, text);
+    lv_obj_align(label, NULL, LV_ALIGN_IN_TOP_MID, 0, y);
+    return label;
+}
+
+static lv_obj_t *create_control(const char *symbol, const char *cmd, lv_align_t align)
+{
+    lv_obj_t *btn = lv_btn_create(musicCont, NULL);
+    lv_obj_set_size(btn, 64, 50);
+    lv_obj_align(btn, NULL, align, align == LV_ALIGN_IN_BOTTOM_LEFT ? 10 : align == LV_ALIGN_IN_BOTTOM_RIGHT ? -10 : 0, -10);
+    lv_obj_set_user_data(btn, (void *)cmd);
+    lv_obj_set_event_cb(btn, control_cb);
+    lv_obj_t *label = lv_label_create(btn, NULL);
+    lv_label_set_text_static(label, symbol);
+    return label;
+}
+
+static void music_create()
+{
+    static lv_style_t musicStyle;
+    static bool styled = false;
+    if (!styled) {
+        int arena = lvmem_arena_suspend();
+        lv_style_init(&musicStyle);
+        lv_style_set_radius(&musicStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_bg_color(&musicStyle, LV_OBJ_PART_MAIN, LV_COLOR_GRAY);
+        lv_style_set_bg_opa(&musicStyle, LV_OBJ_PART_MAIN, LV_OPA_0);
+        lv_style_set_border_width(&musicStyle, LV_OBJ_PART_MAIN, 0);
+        lv_style_set_text_color(&musicStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+        lv_style_set_text_font(&musicStyle, LV_STATE_DEFAULT, font_text());
+        lvmem_arena_resume(arena);
+        styled = true;
+    }
+
+    StatusBar *bar = StatusBar::getStatusBar();
+    musicCont = lv_cont_create(lv_scr_act(), NULL);
+    lv_obj_set_size(musicCont, LV_HOR_RES, LV_VER_RES - bar->height());
+    lv_obj_add_style(musicCont, LV_OBJ_PART_MAIN, &musicStyle);
+    lv_obj_align(musicCont, bar->self(), LV_ALIGN_OUT_BOTTOM_MID, 0, 0);
+
+    lv_obj_t *exitBtn = lv_btn_create(musicCont, NULL);
+    lv_obj_set_size(exitBtn, 40, 30);
+    lv_obj_align(exitBtn, NULL, LV_ALIGN_IN_TOP_LEFT, 5, 5);
+    lv_obj_set_event_cb(exitBtn, [](lv_obj_t *obj, lv_event_t event) {
+        if (event != LV_EVENT_CLICKED) return;
+        ScreenStack::getScreenStack()->pop();
+        MenuBar::getMenuBar()->hidden(false);
+    });
+    lv_obj_t *exitLabel = lv_label_create(exitBtn, NULL);
+    lv_label_set_text_static(exitLabel, LV_SYMBOL_LEFT);
+
+    trackLabel = create_label(40, track);
+    artistLabel = create_label(68, artist);
+    albumLabel = create_label(92, album);
+
+    progressBar = lv_bar_create(musicCont, NULL);
+    lv_obj_set_size(progressBar, LV_HOR_RES - 40, 8);
+    lv_obj_align(progressBar, NULL, LV_ALIGN_IN_TOP_MID, 0, 122);
+    positionLabel = create_label(136, positionText);
+
+    create_control(LV_SYMBOL_PREV, "previous", LV_ALIGN_IN_BOTTOM_LEFT);
+    playLabel = create_control(LV_SYMBOL_PLAY, nullptr, LV_ALIGN_IN_BOTTOM_MID);
+    create_control(LV_SYMBOL_NEXT, "next", LV_ALIGN_IN_BOTTOM_RIGHT);
+
+    tickTask = lv_task_create([](lv_task_t *task) {
+        patch_position();
+    }, MUSIC_TICK_MS, LV_TASK_PRIO_OFF, nullptr);
+
+    shownPosition = -1;
+    patch_state();
+    patch_position();
+}
+
+static void music_show()
+{
+    patch_position();
+    lv_obj_set_hidden(musicCont, false);
+    if (playing) lv_task_set_prio(tickTask, LV_TASK_PRIO_LOW);
+}
+
+static void music_hide()
+{
+    lv_task_set_prio(tickTask, LV_TASK_PRIO_OFF);
+    lv_obj_set_hidden(musicCont, true);
+}
+
+static void music_destroy()
+{
+    //! Pinned, never destroyed
+}
+
+static ScreenStack::screen_t musicScreen = {"Music", music_create, music_show, music_hide, music_destroy};
+
+void setupMusic()
+{
+    ScreenStack::getScreenStack()->preload(&musicScreen);
+}
+
+void music_event_cb()
+{
+    ScreenStack::getScreenStack()->push(&musicScreen);
+}
+
+void music_set_info(const char *a, const char *b, const char *t, int32_t dur)
+{
+    updates++;
+    patch_text(MUSIC_FIELD_ARTIST, artist, artistLabel, a);
+    patch_text(MUSIC_FIELD_ALBUM, album, albumLabel, b);
+    patch_text(MUSIC_FIELD_TRACK, track, trackLabel, t);
+    if (dur != duration) {
+        duration = dur;
+        shownPosition = -1;
+    }
+    patch_position();
+}
+
+void music_set_state(const char *state, int32_t pos)
+{
+    updates++;
+    bool play = state != nullptr && !strcmp(state, "play");
+    if (pos >= 0) {
+        position = pos;
+        positionMs = millis();
+    } else if (play != playing) {
+        //! Keep counting from where the local clock had got to
+        position = current_position();
+        positionMs = millis();
+    }
+    if (play != playing) {
+        playing = play;
+        patch_state();
+        if (tickTask != nullptr && lv_obj_get_hidden(musicCont) == false) {
+            lv_task_set_prio(tickTask, playing ? LV_TASK_PRIO_LOW : LV_TASK_PRIO_OFF);
+        }
+    } else {
+        unchanged++;
+    }
+    patch_position();
+}
+
+void music_report()
+{
+    Serial.printf("Music: %u updates, %u unchanged fields skipped, %u commands\n", updates, unchanged, commands);
+    for (int f = 0; f < MUSIC_FIELDS; f++) {
+        Serial.printf("  %-8s %u redraws\n", fieldNames[f], patches[f]);
+    }
+}
@@ -0,0 +1,318 @@
+#include "config.h"
+#include <Arduino.h>
+#include "gui.h"
+#include "bletx.h"
+#include "fonts.h"
+#include "call.h"
+#include "notifyview.h"
+
+typedef enum {
+    PAINT_SHORT,
+    PAINT_MEDIUM,
+    PAINT_LONG,
+    PAINT_BUCKETS,
+} paint_bucket_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t totalUs;
+    uint32_t maxUs;
+} paint_stats_t;
+
+static const char *const bucketNames[PAINT_BUCKETS] = {"<=256 B", "<=1 KB", ">1 KB"};
+
+static uint32_t notifyId = 0;
+static char header[NOTIFY_HEADER_SIZE];
+static char body[NOTIFY_BODY_SIZE + 1];
+static size_t bodyLen = 0;
+//! Copy of the page being shown, the body label points at it
+static char pageText[NOTIFY_PAGE_SIZE];
+static char pageIndicator[16];
+
+//! lineStart[i] is where line i begins, lines of them are known
+static uint16_t lineStart[NOTIFY_MAX_LINES + 1];
+static uint16_t lines = 0;
+static bool laidOut = false;
+static uint16_t page = 0;
+static uint8_t linesPerPage = 1;
+
+static lv_obj_t *viewCont = nullptr;
+static lv_obj_t *headerLabel = nullptr;
+static lv_obj_t *bodyLabel = nullptr;
+static lv_obj_t *pageLabel = nullptr;
+static lv_task_t *layoutTask = nullptr;
+static const lv_font_t *font = nullptr;
+static lv_coord_t letterSpace = 0;
+static lv_coord_t bodyWidth = 0;
+static MBox *mbox = nullptr;
+
+static bool paintPending = false;
+static uint32_t openUs = 0;
+static paint_bucket_t openBucket = PAINT_SHORT;
+static void (*origMonitor)(lv_disp_drv_t *, uint32_t, uint32_t) = nullptr;
+
+static paint_stats_t paints[PAINT_BUCKETS];
+static uint32_t opened = 0;
+static uint32_t pageTurns = 0;
+static uint32_t cachedPages = 0;
+static uint32_t measuredLines = 0;
+static uint32_t layoutUs = 0;
+static uint32_t truncatedLines = 0;
+
+static const char *cannedReplies[] = {"OK", "\n", "On my way", "\n", "Call you later", "\n", "Cancel", ""};
+
+//! Wrap one more line of the body, false once it is all laid out
+static bool layout_line()
+{
+    if (laidOut) return false;
+    uint16_t start = lineStart[lines];
+    if (start >= bodyLen || lines == NOTIFY_MAX_LINES) {
+        if (start < bodyLen) truncatedLines++;
+        laidOut = true;
+        return false;
+    }
+    uint32_t n = _lv_txt_get_next_line(body + start, font, letterSpace, bodyWidth, LV_TXT_FLAG_NONE);
+    if (n == 0) n = 1;
+    lineStart[++lines] = start + n;
+    measuredLines++;
+    return true;
+}
+
+static void layout_until(uint16_t line)
+{
+    uint32_t start = micros();
+    while (lines < line && layout_line());
+    layoutUs += micros() - start;
+}
+
+static uint16_t page_count()
+{
+    return lines == 0 ? 1 : (lines + linesPerPage - 1) / linesPerPage;
+}
+
+static void update_indicator()
+{
+    snprintf(pageIndicator, sizeof(pageIndicator), "%u/%u%s", page + 1, page_count(), laidOut ? "" : "+");
+    lv_label_set_text_static(pageLabel, pageIndicator);
+}
+
+static void show_page(uint16_t p)
+{
+    uint16_t first = p * linesPerPage;
+    if (first + linesPerPage <= lines) {
+        cachedPages++;
+    } else {
+        layout_until(first + linesPerPage);
+    }
+    if (first >= lines && p > 0) return;
+    page = p;
+
+    uint16_t last = first + linesPerPage < lines ? first + linesPerPage : lines;
+    size_t from = lineStart[first];
+    size_t n = lines > 0 ? lineStart[last] - from : 0;
+    if (n > sizeof(pageText) - 1) n = sizeof(pageText) - 1;
+    memcpy(pageText, body + from, n);
+    while (n > 0 && (pageText[n - 1] == '\n' || pageText[n - 1] == '\r')) n--;
+    pageText[n] = '\0';
+    lv_label_set_text_static(bodyLabel, pageText);
+    update_indicator();
+}
+
+static void close_reply()
+{
+    delete mbox;
+    mbox = nullptr;
+}
+
+static void show_canned_replies()
+{
+    close_reply();
+    mbox = new MBox;
+    //! Same layer as the view, so it goes on top of it
+    mbox->create("Reply", [](lv_obj_t *obj, lv_event_t event) {
+        if (event != LV_EVENT_VALUE_CHANGED) return;
+        const char *txt = lv_msgbox_get_active_btn_text(obj);
+        if (txt == nullptr) return;
+        if (!strcmp(txt, "Cancel")) {
+            close_reply();
+            return;
+        }
+        tx_action("{\"t\":\"notify\",\"id\":%lu,\"n\":\"REPLY\",\"msg\":\"%s\"}", (unsigned long)notifyId, txt);
+        notify_view_hide();
+    }, cannedReplies, lv_layer_top());
+}
+
+static void action_cb(lv_obj_t *obj, lv_event_t event)
+{
+    if (event != LV_EVENT_VALUE_CHANGED) return;
+    const char *txt = lv_btnmatrix_get_active_btn_text(obj);
+    if (txt == nullptr) return;
+    //! Queued for the TX task, the UI never waits on the radio
+    if (!strcmp(txt, "Dismiss")) {
+        tx_action("{\"t\":\"notify\",\"id\":%lu,\"n\":\"DISMISS\"}", (unsigned long)notifyId);
+    } else if (!strcmp(txt, "Open")) {
+        tx_action("{\"t\":\"notify\",\"id\":%lu,\"n\":\"OPEN\"}", (unsigned long)notifyId);
+    } else {
+        show_canned_replies();
+        return;
+    }
+    notify_view_hide();
+}
+
+static void page_cb(lv_obj_t *obj, lv_event_t event)
+{
+    if (event == LV_EVENT_GESTURE) {
+        lv_gesture_dir_t dir = lv_indev_get_gesture_dir(lv_indev_get_act());
+        if (dir == LV_GESTURE_DIR_TOP) {
+            pageTurns++;
+            show_page(page + 1);
+        } else if (dir == LV_GESTURE_DIR_BOTTOM && page > 0) {
+            pageTurns++;
+            show_page(page - 1);
+        }
+    } else if (event == LV_EVENT_CLICKED) {
+        //! Tapping the text pages forward and wraps around to the start
+        pageTurns++;
+        show_page(page + 1 < page_count() || !laidOut ? page + 1 : 0);
+    }
+}
+
+//! Called after every display refresh, catches the first one with the view on it
+static void paint_monitor(lv_disp_drv_t *drv, uint32_t time, uint32_t px)
+{
+    if (paintPending) {
+        paintPending = false;
+        uint32_t us = micros() - openUs;
+        paint_stats_t *s = &paints[openBucket];
+        s->count++;
+        s->totalUs += us;
+        if (us > s->maxUs) s->maxUs = us;
+    }
+    if (origMonitor != nullptr) origMonitor(drv, time, px);
+}
+
+void setupNotifyView()
+{
+    static lv_style_t viewStyle;
+    lv_style_init(&viewStyle);
+    lv_style_set_radius(&viewStyle, LV_OBJ_PART_MAIN, 0);
+    lv_style_set_bg_color(&viewStyle, LV_OBJ_PART_MAIN, LV_COLOR_BLACK);
+    lv_style_set_bg_opa(&viewStyle, LV_OBJ_PART_MAIN, LV_OPA_COVER);
+    lv_style_set_border_width(&viewStyle, LV_OBJ_PART_MAIN, 0);
+    lv_style_set_text_color(&viewStyle, LV_OBJ_PART_MAIN, LV_COLOR_WHITE);
+    //! Message text can be in any script
+    lv_style_set_text_font(&viewStyle, LV_STATE_DEFAULT, font_text());
+
+    viewCont = lv_cont_create(lv_layer_top(), NULL);
+    lv_obj_set_size(viewCont, LV_HOR_RES, LV_VER_RES);
+    lv_obj_add_style(viewCont, LV_OBJ_PART_MAIN, &viewStyle);
+    lv_obj_set_click(viewCont, true);
+    lv_obj_set_event_cb(viewCont, page_cb);
+
+    headerLabel = lv_label_create(viewCont, NULL);
+    lv_label_set_long_mode(headerLabel, LV_LABEL_LONG_DOT);
+    lv_obj_set_width(headerLabel, LV_HOR_RES - 20);
+    lv_label_set_text_static(headerLabel, header);
+    lv_obj_align(headerLabel, NULL, LV_ALIGN_IN_TOP_LEFT, 10, 8);
+
+    lv_obj_t *btns = lv_btnmatrix_create(viewCont, NULL);
+    static const char *map[] = {"Dismiss", "Open", "Reply", ""};
+    lv_btnmatrix_set_map(btns, map);
+    lv_obj_set_size(btns, LV_HOR_RES, 44);
+    lv_obj_align(btns, NULL, LV_ALIGN_IN_BOTTOM_MID, 0, 0);
+    lv_obj_set_event_cb(btns, action_cb);
+
+    pageLabel = lv_label_create(viewCont, NULL);
+    lv_label_set_text_static(pageLabel, pageIndicator);
+    lv_obj_align(pageLabel, btns, LV_ALIGN_OUT_TOP_RIGHT, -10, -2);
+
+    bodyLabel = lv_label_create(viewCont, NULL);
+    lv_label_set_long_mode(bodyLabel, LV_LABEL_LONG_BREAK);
+    bodyWidth = LV_HOR_RES - 20;
+    lv_obj_set_width(bodyLabel, bodyWidth);
+    lv_label_set_text_static(bodyLabel, pageText);
+    lv_obj_align(bodyLabel, headerLabel, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 8);
+    lv_obj_set_click(bodyLabel, true);
+    lv_obj_set_event_cb(bodyLabel, page_cb);
+
+    //! Wrap with exactly what the label will use, so both break in the same places
+    font = lv_obj_get_style_text_font(bodyLabel, LV_LABEL_PART_MAIN);
+    letterSpace = lv_obj_get_style_text_letter_space(bodyLabel, LV_LABEL_PART_MAIN);
+    lv_coord_t lineHeight = lv_font_get_line_height(font) + lv_obj_get_style_text_line_space(bodyLabel, LV_LABEL_PART_MAIN);
+    lv_coord_t height = lv_obj_get_y(pageLabel) - lv_obj_get_y(bodyLabel) - 4;
+    linesPerPage = height > lineHeight ? height / lineHeight : 1;
+
+    lv_obj_set_hidden(viewCont, true);
+
+    layoutTask = lv_task_create([](lv_task_t *task) {
+        uint32_t start = micros();
+        for (int i = 0; i < NOTIFY_LAYOUT_STEP; i++) {
+            if (!layout_line()) break;
+        }
+        layoutUs += micros() - start;
+        update_indicator();
+        if (laidOut) lv_task_set_prio(task, LV_TASK_PRIO_OFF);
+    }, NOTIFY_LAYOUT_MS, LV_TASK_PRIO_OFF, nullptr);
+
+    lv_disp_t *disp = lv_disp_get_default();
+    if (disp != nullptr) {
+        origMonitor = disp->driver.monitor_cb;
+        disp->driver.monitor_cb = paint_monitor;
+    }
+}
+
+void notify_view_show(uint32_t id, const char *src, const char *title, const char *text)
+{
+    if (viewCont == nullptr) return;
+    close_reply();
+    opened++;
+    openUs = micros();
+    notifyId = id;
+
+    snprintf(header, sizeof(header), "%s: %s", src != nullptr ? src : "", title != nullptr ? title : "");
+    lv_label_set_text_static(headerLabel, header);
+
+    bodyLen = strlcpy(body, text != nullptr ? text : "", sizeof(body));
+    if (bodyLen >= sizeof(body)) bodyLen = sizeof(body) - 1;
+    openBucket = bodyLen <= 256 ? PAINT_SHORT : bodyLen <= 1024 ? PAINT_MEDIUM : PAINT_LONG;
+    lines = 0;
+    lineStart[0] = 0;
+    laidOut = bodyLen == 0;
+
+    //! Only the first page now, the rest in the background
+    show_page(0);
+    //! A ringing call stays on top, the notification waits underneath it
+    if (!call_active()) {
+        lv_obj_move_foreground(viewCont);
+    }
+    lv_obj_set_hidden(viewCont, false);
+    lv_disp_trig_activity(NULL);
+    if (!laidOut) {
+        lv_task_set_prio(layoutTask, LV_TASK_PRIO_LOWEST);
+        lv_task_reset(layoutTask);
+    }
+
+    //! With the screen off the first frame waits for the wake, that is not our cost
+    paintPending = TTGOClass::getWatch()->bl->isOn();
+}
+
+void notify_view_hide()
+{
+    close_reply();
+    if (viewCont == nullptr) return;
+    lv_task_set_prio(layoutTask, LV_TASK_PRIO_OFF);
+    lv_obj_set_hidden(viewCont, true);
+    notifyId = 0;
+}
+
+void notify_view_report()
+{
+    Serial.printf("Notifications: %u shown, %u page turns (%u from cache), %u lines wrapped in %u us",
+                  opened, pageTurns, cachedPages, measuredLines, layoutUs);
+    Serial.printf(", %u lines/page, %u truncated\n", linesPerPage, truncatedLines);
+    for (int b = 0; b < PAINT_BUCKETS; b++) {
+        paint_stats_t *s = &paints[b];
+        if (s->count == 0) continue;
+        Serial.printf("  %-7s first paint avg %u us, max %u us (n=%u)\n", bucketNames[b], s->totalUs / s->count, s->maxUs, s->count);
+    }
+}
@@ -0,0 +1,99 @@
+#include "config.h"
+#include <Arduino.h>
+#include "gui.h"
+#include "pool.h"
+
+PoolBase *PoolBase::_head = nullptr;
+
+PoolBase::PoolBase(const char *name, uint8_t *storage, size_t slotSize, uint8_t capacity)
+{
+    _name = name;
+    _storage = storage;
+    _slotSize = slotSize;
+    _capacity = capacity;
+    _freeMask = capacity == 32 ? 0xFFFFFFFF : (1UL << capacity) - 1;
+    _next = _head;
+    _head = this;
+}
+
+void *PoolBase::alloc(size_t size)
+{
+    void *p = nullptr;
+    portENTER_CRITICAL(&_mux);
+    if (size <= _slotSize && _freeMask) {
+        int slot = __builtin_ctz(_freeMask);
+        _freeMask &= ~(1UL << slot);
+        p = _storage + slot * _slotSize;
+        if (++_used > _peak) _peak = _used;
+    } else {
+        _overflows++;
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    if (p == nullptr) {
+        Serial.printf("Pool %s exhausted, using heap\n", _name);
+        p = ::operator new(size);
+    }
+    return p;
+}
+
+void PoolBase::free(void *p)
+{
+    if (p == nullptr) return;
+    uint8_t *b = (uint8_t *)p;
+    if (b < _storage || b >= _storage + _slotSize * _capacity) {
+        ::operator delete(p);
+        return;
+    }
+    int slot = (b - _storage) / _slotSize;
+    portENTER_CRITICAL(&_mux);
+    _freeMask |= 1UL << slot;
+    _used--;
+    portEXIT_CRITICAL(&_mux);
+}
+
+void PoolBase::report(const char *tag)
+{
+    Serial.printf("Pools (%s):\n", tag);
+    for (PoolBase *pool = _head; pool != nullptr; pool = pool->_next) {
+        Serial.printf("  %-9s %2u/%-2u used, peak %2u, %u heap fallbacks\n", pool->_name,
+                      pool->_used, pool->_capacity, pool->_peak, pool->_overflows);
+    }
+    lv_mem_monitor_t mon;
+    lv_mem_monitor(&mon);
+    Serial.printf("  heap free %u, largest block %u; lvgl draw pool free %u, frag %u%%\n",
+                  heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+                  heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL),
+                  mon.free_size, mon.frag_pct);
+}
+
+#if POOL_SOAK_TEST
+void pool_soak_test(uint32_t cycles)
+{
+    PoolBase::report("before soak");
+    static const char *names[] = {"a", "b", "c"};
+    for (uint32_t i = 0; i < cycles; i++) {
+        MBox *mbox = new MBox;
+        mbox->create("soak", nullptr);
+        List *list = new List;
+        list->create();
+        list->add(names[i % 3]);
+        Preload *pl = new Preload;
+        pl->create();
+        Task *task = new Task;
+        task->create([](lv_task_t *t) {}, 1000);
+        if (i % 8 == 0) {
+            Keyboard *kb = new Keyboard;
+            kb->create();
+            delete kb;
+        }
+        delete task;
+        delete pl;
+        delete list;
+        delete mbox;
+    }
+    PoolBase::report("after soak");
+}
+#else
+void pool_soak_test(uint32_t cycles) {}
+#endif
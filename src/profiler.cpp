@@ -0,0 +1,241 @@
+/*
+    Frame profiler.
+
+    Every lv_task callback is swapped for a trampoline that times the real
+    callback, the display flush_cb is wrapped the same way, and loop()
+    brackets lv_task_handler() with profiler_frame_begin/end. Render time
+    is the display refresh task minus the time spent flushing. Histograms
+    are only ever incremented with relaxed atomics, so profiler_dump() can
+    read them from anywhere without locking.
+*/
+
+#include "config.h"
+#include <Arduino.h>
+#include "profiler.h"
+
+#if WATCH_PROFILER
+
+#include "lvgl/src/lv_misc/lv_gc.h"
+
+typedef struct {
+    uint32_t buckets[PROFILER_BUCKETS];
+    uint32_t count;
+    uint32_t totalUs;
+    uint32_t maxUs;
+} histogram_t;
+
+typedef struct {
+    lv_task_t *task;
+    lv_task_cb_t cb;
+    histogram_t hist;
+} task_slot_t;
+
+//! Upper bounds of the histogram buckets, the last one is open ended
+static const uint32_t bucketUs[PROFILER_BUCKETS - 1] = {
+    250, 500, 1000, 2000, 4000, 8000, 16000, 33000, 66000
+};
+
+static task_slot_t slots[PROFILER_MAX_TASKS];
+static histogram_t frameHist, renderHist, flushHist;
+static uint32_t janks = 0;
+
+static void (*origFlush)(lv_disp_drv_t *, const lv_area_t *, lv_color_t *) = nullptr;
+
+static uint32_t frameStart;
+static uint32_t frameFlushUs;
+static uint32_t frameRefrUs;
+static task_slot_t *frameWorst;
+static uint32_t frameWorstUs;
+
+static void record(histogram_t *h, uint32_t us)
+{
+    int b = 0;
+    while (b < PROFILER_BUCKETS - 1 && us > bucketUs[b]) {
+        b++;
+    }
+    __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->totalUs, us, __ATOMIC_RELAXED);
+    if (us > __atomic_load_n(&h->maxUs, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&h->maxUs, us, __ATOMIC_RELAXED);
+    }
+}
+
+static const char *task_name(const task_slot_t *slot)
+{
+    lv_disp_t *disp = lv_disp_get_default();
+    if (disp != nullptr && slot->task == disp->refr_task) return "refresh";
+    for (lv_indev_t *indev = lv_indev_get_next(NULL); indev != nullptr; indev = lv_indev_get_next(indev)) {
+        if (slot->task == indev->driver.read_task) return "indev";
+    }
+    return nullptr;
+}
+
+static void profiled_task_cb(lv_task_t *task)
+{
+    task_slot_t *slot = nullptr;
+    for (int i = 0; i < PROFILER_MAX_TASKS; i++) {
+        if (slots[i].task == task) {
+            slot = &slots[i];
+            break;
+        }
+    }
+    if (slot == nullptr) return;
+
+    lv_task_cb_t cb = slot->cb;
+    uint32_t start = micros();
+    cb(task);
+    uint32_t us = micros() - start;
+
+    //! The callback may have deleted its own task, only touch the slot
+    record(&slot->hist, us);
+    lv_disp_t *disp = lv_disp_get_default();
+    if (disp != nullptr && task == disp->refr_task) {
+        frameRefrUs += us;
+    }
+    if (us > frameWorstUs) {
+        frameWorstUs = us;
+        frameWorst = slot;
+    }
+}
+
+static void profiled_flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_p)
+{
+    uint32_t start = micros();
+    origFlush(drv, area, color_p);
+    uint32_t us = micros() - start;
+    record(&flushHist, us);
+    frameFlushUs += us;
+}
+
+//! Wrap callbacks of tasks created since the last frame and forget deleted ones
+static void scan_tasks()
+{
+    bool seen[PROFILER_MAX_TASKS] = {false};
+
+    lv_task_t *task = (lv_task_t *)_lv_ll_get_head(&LV_GC_ROOT(_lv_task_ll));
+    while (task != nullptr) {
+        int found = -1;
+        for (int i = 0; i < PROFILER_MAX_TASKS; i++) {
+            if (slots[i].task == task) {
+                found = i;
+                break;
+            }
+        }
+        if (found < 0) {
+            for (int i = 0; i < PROFILER_MAX_TASKS; i++) {
+                if (slots[i].task == nullptr && !seen[i]) {
+                    found = i;
+                    memset(&slots[i], 0, sizeof(slots[i]));
+                    slots[i].task = task;
+                    break;
+                }
+            }
+        }
+        if (found >= 0) {
+            seen[found] = true;
+            if (task->task_cb != profiled_task_cb) {
+                slots[found].cb = task->task_cb;
+                task->task_cb = profiled_task_cb;
+            }
+        }
+        task = (lv_task_t *)_lv_ll_get_next(&LV_GC_ROOT(_lv_task_ll), task);
+    }
+
+    for (int i = 0; i < PROFILER_MAX_TASKS; i++) {
+        if (!seen[i]) {
+            slots[i].task = nullptr;
+        }
+    }
+}
+
+void setupProfiler()
+{
+    lv_disp_t *disp = lv_disp_get_default();
+    if (disp != nullptr && origFlush == nullptr) {
+        origFlush = disp->driver.flush_cb;
+        disp->driver.flush_cb = profiled_flush_cb;
+    }
+    scan_tasks();
+}
+
+void profiler_frame_begin()
+{
+    scan_tasks();
+    frameFlushUs = 0;
+    frameRefrUs = 0;
+    frameWorst = nullptr;
+    frameWorstUs = 0;
+    frameStart = micros();
+}
+
+void profiler_frame_end()
+{
+    uint32_t us = micros() - frameStart;
+    record(&frameHist, us);
+    if (frameRefrUs) {
+        record(&renderHist, frameRefrUs > frameFlushUs ? frameRefrUs - frameFlushUs : 0);
+    }
+    if (us > PROFILER_JANK_US) {
+        janks++;
+        const char *name = frameWorst != nullptr ? task_name(frameWorst) : nullptr;
+        Serial.printf("Jank: frame %u us (render %u us, flush %u us), slowest task ", us,
+                      frameRefrUs > frameFlushUs ? frameRefrUs - frameFlushUs : 0, frameFlushUs);
+        if (name != nullptr) {
+            Serial.printf("%s %u us\n", name, frameWorstUs);
+        } else if (frameWorst != nullptr) {
+            Serial.printf("cb %p %u us\n", frameWorst->cb, frameWorstUs);
+        } else {
+            Serial.println("none");
+        }
+    }
+}
+
+static void dump_hist(const char *name, const histogram_t *h)
+{
+    uint32_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    if (count == 0) return;
+    Serial.printf("  %-12s n=%-7u avg %6u us max %6u us |", name, count,
+                  __atomic_load_n(&h->totalUs, __ATOMIC_RELAXED) / count,
+                  __atomic_load_n(&h->maxUs, __ATOMIC_RELAXED));
+    for (int i = 0; i < PROFILER_BUCKETS; i++) {
+        Serial.printf(" %u", __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED));
+    }
+    Serial.println();
+}
+
+void profiler_dump()
+{
+    Serial.print("Frames (buckets <=");
+    for (int i = 0; i < PROFILER_BUCKETS - 1; i++) {
+        Serial.printf(" %u", bucketUs[i]);
+    }
+    Serial.printf(" us, >), %u janks over %u us:\n", janks, PROFILER_JANK_US);
+    dump_hist("frame", &frameHist);
+    dump_hist("render", &renderHist);
+    dump_hist("flush", &flushHist);
+    for (int i = 0; i < PROFILER_MAX_TASKS; i++) {
+        if (slots[i].task == nullptr) continue;
+        char name[16];
+        const char *known = task_name(&slots[i]);
+        if (known != nullptr) {
+            strlcpy(name, known, sizeof(name));
+        } else {
+            snprintf(name, sizeof(name), "%p", slots[i].cb);
+        }
+        dump_hist(name, &slots[i].hist);
+    }
+}
+
+void profiler_reset()
+{
+    memset(&frameHist, 0, sizeof(frameHist));
+    memset(&renderHist, 0, sizeof(renderHist));
+    memset(&flushHist, 0, sizeof(flushHist));
+    for (int i = 0; i < PROFILER_MAX_TASKS; i++) {
+        memset(&slots[i].hist, 0, sizeof(slots[i].hist));
+    }
+    janks = 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "config.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include "esp_coexist.h"
+#include "radio.h"
+
+extern bool bleEnabled;
+
+static const char *const clientNames[RADIO_CLIENT_MAX] = {"user", "scan", "ntp", "ota"};
+
+static bool held[RADIO_CLIENT_MAX];
+static uint32_t heldSince[RADIO_CLIENT_MAX];
+static uint32_t heldMs[RADIO_CLIENT_MAX];
+static uint32_t acquires[RADIO_CLIENT_MAX];
+static uint8_t users = 0;
+
+static bool on = false;
+static uint32_t onSince = 0;
+static uint32_t onMs = 0;
+static uint32_t idleSince = 0;
+static uint32_t powerUps = 0;
+
+//! Short bursts (scans, NTP) get the air time, otherwise keep BLE responsive
+static void update_coex()
+{
+    if (!bleEnabled) return;
+    if (!on) {
+        esp_coex_preference_set(ESP_COEX_PREFER_BT);
+    } else if (held[RADIO_CLIENT_SCAN] || held[RADIO_CLIENT_NTP] || held[RADIO_CLIENT_OTA]) {
+        esp_coex_preference_set(ESP_COEX_PREFER_WIFI);
+    } else {
+        esp_coex_preference_set(ESP_COEX_PREFER_BALANCE);
+    }
+}
+
+static void power(bool en)
+{
+    if (en == on) return;
+    on = en;
+    if (en) {
+        powerUps++;
+        onSince = millis();
+        WiFi.mode(WIFI_STA);
+    } else {
+        onMs += millis() - onSince;
+        WiFi.mode(WIFI_OFF);
+    }
+}
+
+void radio_acquire(radio_client_t client)
+{
+    if (held[client]) return;
+    held[client] = true;
+    heldSince[client] = millis();
+    acquires[client]++;
+    users++;
+    power(true);
+    update_coex();
+}
+
+void radio_release(radio_client_t client)
+{
+    if (!held[client]) return;
+    held[client] = false;
+    heldMs[client] += millis() - heldSince[client];
+    if (--users == 0) {
+        idleSince = millis();
+    }
+    update_coex();
+}
+
+void radio_shutdown()
+{
+    for (int i = 0; i < RADIO_CLIENT_MAX; i++) {
+        radio_release((radio_client_t)i);
+    }
+    power(false);
+    update_coex();
+}
+
+void radio_poll()
+{
+    if (on && users == 0 && millis() - idleSince > RADIO_IDLE_MS) {
+        Serial.println("Radio: idle, switching WiFi off");
+        power(false);
+        update_coex();
+    }
+}
+
+bool radio_on()
+{
+    return on;
+}
+
+void radio_report()
+{
+    uint32_t now = millis();
+    Serial.printf("Radio: %s, %u clients, %u power ups, on for %u ms\n", on ? "on" : "off", users, powerUps,
+                  onMs + (on ? now - onSince : 0));
+    for (int i = 0; i < RADIO_CLIENT_MAX; i++) {
+        if (acquires[i] == 0) continue;
+        Serial.printf("  %-6s %u acquires, held %u ms%s\n", clientNames[i], acquires[i],
+                      heldMs[i] + (held[i] ? now - heldSince[i] : 0), held[i] ? " (holding)" : "");
+    }
+}
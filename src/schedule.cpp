@@ -0,0 +1,305 @@
+#include "config.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+#include "gui.h"
+#include "main.h"
+#include "timekeeper.h"
+#include "schedule.h"
+
+//! Bumped when schedule_event_t changes, saved events of another layout are dropped
+#define SCHEDULE_VERSION    2
+
+static schedule_event_t events[SCHEDULE_MAX];
+static uint8_t count = 0;
+//! Events before this one have already gone off
+static uint8_t nextDue = 0;
+//! Every event up to here has been handled
+static uint32_t handledUntil = 0;
+//! Time in the RTC alarm registers, 0 when disabled
+static uint32_t programmed = 0;
+static bool dirty = false;
+static MBox *mbox = nullptr;
+
+static uint32_t irqs = 0;
+static uint32_t early = 0;
+static uint32_t fired = 0;
+static uint32_t reprograms = 0;
+static uint32_t full = 0;
+static uint32_t clockChanges = 0;
+
+static void schedule_program();
+
+//! Next time after `after` that the alarm goes off
+static uint32_t alarm_next(const schedule_event_t *e, uint32_t after)
+{
+    time_t t = after;
+    struct tm info;
+    localtime_r(&t, &info);
+    info.tm_hour = e->hour;
+    info.tm_min = e->minute;
+    info.tm_sec = 0;
+    info.tm_isdst = -1;
+    for (int i = 0; i < 8; i++) {
+        time_t next = mktime(&info);
+        //! tm_wday is 0 on Sunday, the phone's mask starts at Monday
+        if (next > (time_t)after && (e->repeat == 0 || (e->repeat & (1 << ((info.tm_wday + 6) % 7))))) {
+            return (uint32_t)next;
+        }
+        info.tm_mday++;
+        info.tm_isdst = -1;
+    }
+    return 0;
+}
+
+//! Keep the array sorted by time, insertion sort as it is almost always in order
+static void sort()
+{
+    for (int i = 1; i < count; i++) {
+        schedule_event_t e = events[i];
+        int j = i - 1;
+        while (j >= 0 && events[j].time > e.time) {
+            events[j + 1] = events[j];
+            j--;
+        }
+        events[j + 1] = e;
+    }
+    nextDue = 0;
+    while (nextDue < count && events[nextDue].time <= handledUntil) nextDue++;
+}
+
+static void remove_at(int i)
+{
+    memmove(&events[i], &events[i + 1], (count - i - 1) * sizeof(events[0]));
+    count--;
+    dirty = true;
+}
+
+static bool append(const schedule_event_t *e)
+{
+    if (count == SCHEDULE_MAX) {
+        full++;
+        return false;
+    }
+    events[count++] = *e;
+    dirty = true;
+    return true;
+}
+
+static void save()
+{
+    Preferences prefs;
+    prefs.begin("schedule", false);
+    prefs.putUChar("version", SCHEDULE_VERSION);
+    prefs.putBytes("events", events, count * sizeof(events[0]));
+    prefs.end();
+    dirty = false;
+}
+
+static void notify(const schedule_event_t *e)
+{
+    char text[64 + SCHEDULE_TITLE_SIZE];
+    if (e->kind == SCHEDULE_ALARM) {
+        snprintf(text, sizeof(text), "Alarm\n\n%02u:%02u", e->hour, e->minute);
+    } else {
+        time_t t = e->time;
+        struct tm info;
+        localtime_r(&t, &info);
+        snprintf(text, sizeof(text), "%s\n\n%02d:%02d", e->title, info.tm_hour, info.tm_min);
+    }
+    delete mbox;
+    mbox = new MBox;
+    mbox->create(text, [](lv_obj_t *obj, lv_event_t event) {
+        if (event == LV_EVENT_VALUE_CHANGED) {
+            delete mbox;
+            mbox = nullptr;
+        }
+    });
+
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    if (!ttgo->bl->isOn()) {
+        xEventGroupSetBits(*get_isr_group(), WATCH_FLAG_SLEEP_EXIT);
+    }
+    ttgo->motor->adjust(255);
+    ttgo->motor->onec();
+}
+
+void setupSchedule()
+{
+    Preferences prefs;
+    prefs.begin("schedule", true);
+    size_t len = prefs.getBytesLength("events");
+    if (prefs.getUChar("version", 0) == SCHEDULE_VERSION && len % sizeof(events[0]) == 0 && len <= sizeof(events)) {
+        prefs.getBytes("events", events, len);
+        count = len / sizeof(events[0]);
+    }
+    prefs.end();
+
+    //! Anything that went off while we were not running is not shown late
+    uint32_t now = (uint32_t)time(nullptr);
+    handledUntil = now;
+    for (int i = 0; i < count; i++) {
+        if (events[i].kind == SCHEDULE_ALARM && events[i].time <= now) {
+            events[i].time = events[i].end = events[i].repeat ? alarm_next(&events[i], now) : 0;
+        } else if (events[i].kind == SCHEDULE_CALENDAR) {
+            //! They may have been saved while the clock held UTC, it is local time until NTP runs
+            uint32_t duration = events[i].end - events[i].time;
+            events[i].time = timekeeper_from_utc(events[i].utc);
+            events[i].end = events[i].time + duration;
+        }
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        if (events[i].time == 0 || events[i].end < now) remove_at(i);
+    }
+    sort();
+    schedule_commit();
+}
+
+void schedule_clear_alarms()
+{
+    for (int i = count - 1; i >= 0; i--) {
+        if (events[i].kind == SCHEDULE_ALARM) remove_at(i);
+    }
+}
+
+bool schedule_add_alarm(uint8_t hour, uint8_t minute, uint8_t repeat)
+{
+    schedule_event_t e;
+    memset(&e, 0, sizeof(e));
+    e.kind = SCHEDULE_ALARM;
+    e.hour = hour;
+    e.minute = minute;
+    e.repeat = repeat & 0x7F;
+    //! Not before now, handledUntil is only the last boot or alarm
+    uint32_t now = (uint32_t)time(nullptr);
+    e.time = e.end = alarm_next(&e, now > handledUntil ? now : handledUntil);
+    if (e.time == 0) return false;
+    return append(&e);
+}
+
+bool schedule_add_calendar(uint32_t id, uint32_t startUtc, uint32_t duration, const char *title)
+{
+    schedule_remove_calendar(id);
+    uint32_t start = timekeeper_from_utc(startUtc);
+    if (start + duration < handledUntil) return false;
+    schedule_event_t e;
+    memset(&e, 0, sizeof(e));
+    e.kind = SCHEDULE_CALENDAR;
+    e.id = id;
+    e.utc = startUtc;
+    e.time = start;
+    e.end = start + duration;
+    strlcpy(e.title, title != nullptr ? title : "", sizeof(e.title));
+    return append(&e);
+}
+
+void schedule_remove_calendar(uint32_t id)
+{
+    for (int i = count - 1; i >= 0; i--) {
+        if (events[i].kind == SCHEDULE_CALENDAR && events[i].id == id) remove_at(i);
+    }
+}
+
+void schedule_commit()
+{
+    sort();
+    if (dirty) save();
+    schedule_program();
+}
+
+static void schedule_program()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    uint32_t t = nextDue < count ? events[nextDue].time : 0;
+    if (t == programmed) return;
+    programmed = t;
+    reprograms++;
+    if (t == 0) {
+        ttgo->rtc->disableAlarm();
+        return;
+    }
+    time_t tt = t;
+    struct tm info;
+    localtime_r(&tt, &info);
+    ttgo->rtc->disableAlarm();
+    ttgo->rtc->setAlarm(info.tm_hour, info.tm_min, info.tm_mday, PCF8563_NO_ALARM);
+    ttgo->rtc->resetAlarm();
+    ttgo->rtc->enableAlarm();
+}
+
+void schedule_clock_changed()
+{
+    //! Stored times are system clock seconds, which an NTP sync shifts by
+    //! the zone offset, so work them out again from what the phone sent
+    uint32_t now = (uint32_t)time(nullptr);
+    clockChanges++;
+    handledUntil = now;
+    for (int i = 0; i < count; i++) {
+        schedule_event_t *e = &events[i];
+        uint32_t t, end;
+        if (e->kind == SCHEDULE_ALARM) {
+            t = end = alarm_next(e, now);
+        } else {
+            t = timekeeper_from_utc(e->utc);
+            end = t + (e->end - e->time);
+        }
+        if (t != e->time || end != e->end) {
+            e->time = t;
+            e->end = end;
+            dirty = true;
+        }
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        if (events[i].time == 0 || events[i].end < now) remove_at(i);
+    }
+    //! The RTC may hold another time now, write the alarm even if the event is the same
+    programmed = 0;
+    schedule_commit();
+}
+
+void schedule_irq()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    ttgo->rtc->resetAlarm();
+    irqs++;
+
+    //! The RTC only has minutes, all of this minute is due
+    uint32_t now = (uint32_t)time(nullptr);
+    uint32_t until = now - now % 60 + 59;
+    if (nextDue >= count || events[nextDue].time > until) {
+        //! Day of month matched a month early, or the clock moved
+        early++;
+        programmed = 0;
+        schedule_program();
+        return;
+    }
+
+    for (int i = nextDue; i < count && events[i].time <= until; i++) {
+        fired++;
+        notify(&events[i]);
+        if (events[i].kind == SCHEDULE_ALARM) {
+            events[i].time = events[i].end = events[i].repeat ? alarm_next(&events[i], until) : 0;
+            dirty = true;
+        }
+    }
+    handledUntil = until;
+
+    //! Single alarms that went off and calendar events that are over
+    for (int i = count - 1; i >= 0; i--) {
+        if (events[i].time == 0 || events[i].end < now) remove_at(i);
+    }
+    schedule_commit();
+}
+
+void schedule_report()
+{
+    Serial.printf("Schedule: %u/%u events, next %u, %u irqs, %u early, %u fired, %u reprograms, %u full, %u clock changes\n",
+                  count, SCHEDULE_MAX, nextDue, irqs, early, fired, reprograms, full, clockChanges);
+    for (int i = nextDue; i < count && i < nextDue + 3; i++) {
+        time_t t = events[i].time;
+        struct tm info;
+        localtime_r(&t, &info);
+        Serial.printf("  %s %04d-%02d-%02d %02d:%02d %s\n", events[i].kind == SCHEDULE_ALARM ? "alarm   " : "calendar",
+                      info.tm_year + 1900, info.tm_mon + 1, info.tm_mday, info.tm_hour, info.tm_min, events[i].title);
+    }
+}
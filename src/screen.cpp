@@ -0,0 +1,186 @@
+/*
+    Screen stack with a cache of constructed screens.
+
+    A screen is a set of create/show/hide/destroy hooks. Pushing a screen
+    hides the one below it instead of deleting it, and popping leaves the
+    popped screen built but hidden. Hidden screens that are not on the
+    stack stay cached until their combined LVGL heap use goes over
+    SCREEN_CACHE_BUDGET, then the least recently used ones are destroyed.
+    Reopening a cached screen only runs its show hook. Each screen is built
+    in its own LVGL memory arena, which is released when it is destroyed.
+    Preloaded screens are built up front, outside any arena, and are never
+    evicted, so opening them never allocates.
+*/
+
+#include "config.h"
+#include <Arduino.h>
+#include "screen.h"
+#include "lvmem.h"
+
+static ScreenStack screens;
+
+ScreenStack::ScreenStack()
+{
+    memset(_stack, 0, sizeof(_stack));
+    memset(_cached, 0, sizeof(_cached));
+}
+
+ScreenStack* ScreenStack::getScreenStack()
+{
+    return &screens;
+}
+
+void ScreenStack::push(screen_t *screen)
+{
+    if (_depth >= SCREEN_STACK_DEPTH) {
+        Serial.printf("Screen: stack full, can't open %s\n", screen->name);
+        return;
+    }
+    if (_depth > 0) {
+        _stack[_depth - 1]->hide();
+    }
+    _stack[_depth++] = screen;
+    open(screen);
+}
+
+void ScreenStack::preload(screen_t *screen)
+{
+    if (screen->built) return;
+    track(screen);
+    uint32_t before = lvmem_used();
+    uint32_t start = micros();
+    screen->create();
+    screen->hide();
+    screen->createUs = micros() - start;
+    uint32_t after = lvmem_used();
+    screen->cost = after > before ? after - before : 0;
+    screen->arena = LVMEM_NO_ARENA;
+    screen->built = true;
+    screen->pinned = true;
+    Serial.printf("Screen: preloaded %s in %u us, %u bytes\n", screen->name, screen->createUs, screen->cost);
+}
+
+void ScreenStack::pop()
+{
+    if (_depth == 0) return;
+    screen_t *screen = _stack[--_depth];
+    screen->hide();
+    if (_depth > 0) {
+        open(_stack[_depth - 1]);
+    }
+    trim();
+}
+
+void ScreenStack::replace(screen_t *screen)
+{
+    if (_depth == 0) {
+        push(screen);
+        return;
+    }
+    _stack[_depth - 1]->hide();
+    _stack[_depth - 1] = screen;
+    open(screen);
+    trim();
+}
+
+void ScreenStack::clear()
+{
+    while (_depth > 0) {
+        _stack[--_depth]->hide();
+    }
+    trim();
+}
+
+void ScreenStack::evict(screen_t *screen)
+{
+    if (!screen->built || screen->pinned || onStack(screen)) return;
+    screen->destroy();
+    lvmem_arena_release(screen->arena);
+    screen->built = false;
+    screen->cost = 0;
+}
+
+ScreenStack::screen_t* ScreenStack::top() const
+{
+    return _depth > 0 ? _stack[_depth - 1] : nullptr;
+}
+
+uint8_t ScreenStack::depth() const
+{
+    return _depth;
+}
+
+void ScreenStack::open(screen_t *screen)
+{
+    track(screen);
+    screen->lastUsed = ++_tick;
+    if (screen->built) {
+        screen->hits++;
+    } else {
+        uint32_t before = lvmem_used();
+        uint32_t start = micros();
+        screen->arena = lvmem_arena_begin(screen->name);
+        screen->create();
+        lvmem_arena_end();
+        screen->createUs = micros() - start;
+        uint32_t after = lvmem_used();
+        screen->cost = after > before ? after - before : 0;
+        screen->built = true;
+        screen->misses++;
+        Serial.printf("Screen: built %s in %u us, %u bytes\n", screen->name, screen->createUs, screen->cost);
+    }
+    screen->show();
+}
+
+void ScreenStack::track(screen_t *screen)
+{
+    for (int i = 0; i < _cachedCount; i++) {
+        if (_cached[i] == screen) return;
+    }
+    if (_cachedCount < SCREEN_MAX_CACHED) {
+        _cached[_cachedCount++] = screen;
+    }
+}
+
+bool ScreenStack::onStack(const screen_t *screen) const
+{
+    for (int i = 0; i < _depth; i++) {
+        if (_stack[i] == screen) return true;
+    }
+    return false;
+}
+
+void ScreenStack::trim()
+{
+    while (1) {
+        uint32_t used = 0;
+        screen_t *lru = nullptr;
+        for (int i = 0; i < _cachedCount; i++) {
+            screen_t *s = _cached[i];
+            if (!s->built || s->pinned || onStack(s)) continue;
+            used += s->cost;
+            if (lru == nullptr || s->lastUsed < lru->lastUsed) {
+                lru = s;
+            }
+        }
+        if (lru == nullptr || used <= SCREEN_CACHE_BUDGET) return;
+        Serial.printf("Screen: evicting %s (%u bytes cached)\n", lru->name, used);
+        evict(lru);
+    }
+}
+
+void ScreenStack::report()
+{
+    uint32_t hits = 0, misses = 0;
+    Serial.println("Screen cache:");
+    for (int i = 0; i < _cachedCount; i++) {
+        screen_t *s = _cached[i];
+        Serial.printf("  %-10s %s %6u bytes, build %6u us, %u hits / %u misses\n", s->name,
+                      s->pinned ? "pinned" : s->built ? "cached" : "freed ", s->cost, s->createUs, s->hits, s->misses);
+        hits += s->hits;
+        misses += s->misses;
+    }
+    if (hits + misses) {
+        Serial.printf("  hit rate %u%%\n", hits * 100 / (hits + misses));
+    }
+}
@@ -0,0 +1,151 @@
+#include "config.h"
+#include <Arduino.h>
+#include "gui.h"
+#include "steps.h"
+
+static uint32_t steps = 0;
+static uint32_t shown = UINT32_MAX;
+static uint32_t started = 0;
+static uint16_t watermark = 0;
+
+static uint32_t irqs = 0;
+static uint32_t sleepWakes = 0;
+static uint32_t sleepWakeUs = 0;
+static uint32_t sleepCurrentSum = 0;
+static uint32_t sleepCurrentSamples = 0;
+
+//! The feature config can't be accessed in advanced power save, returns the
+//! power config to restore afterwards
+static uint8_t feature_open(uint8_t *feature)
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    uint8_t pwr, off = 0;
+    ttgo->i2c->readBytes(BMA4_I2C_ADDR_SECONDARY, BMA4_POWER_CONF_ADDR, &pwr, 1);
+    ttgo->i2c->writeBytes(BMA4_I2C_ADDR_SECONDARY, BMA4_POWER_CONF_ADDR, &off, 1);
+    delayMicroseconds(450);
+    ttgo->i2c->readBytes(BMA4_I2C_ADDR_SECONDARY, BMA4_FEATURE_CONFIG_ADDR, feature, BMA423_FEATURE_SIZE);
+    return pwr;
+}
+
+static void feature_close(uint8_t pwr)
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    ttgo->i2c->writeBytes(BMA4_I2C_ADDR_SECONDARY, BMA4_POWER_CONF_ADDR, &pwr, 1);
+}
+
+bool bma_feature_update(uint8_t offset, uint16_t mask, uint16_t value)
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    uint8_t feature[BMA423_FEATURE_SIZE];
+    uint8_t pwr = feature_open(feature);
+
+    uint16_t word = feature[offset] | (feature[offset + 1] << 8);
+    word = (word & ~mask) | (value & mask);
+    feature[offset] = word & 0xFF;
+    feature[offset + 1] = word >> 8;
+    ttgo->i2c->writeBytes(BMA4_I2C_ADDR_SECONDARY, BMA4_FEATURE_CONFIG_ADDR, feature, sizeof(feature));
+
+    uint8_t check[BMA423_FEATURE_SIZE];
+    ttgo->i2c->readBytes(BMA4_I2C_ADDR_SECONDARY, BMA4_FEATURE_CONFIG_ADDR, check, sizeof(check));
+    feature_close(pwr);
+    return memcmp(feature, check, sizeof(check)) == 0;
+}
+
+uint16_t bma_feature_read(uint8_t offset)
+{
+    uint8_t feature[BMA423_FEATURE_SIZE];
+    feature_close(feature_open(feature));
+    return feature[offset] | (feature[offset + 1] << 8);
+}
+
+static void steps_task(lv_task_t *t)
+{
+    steps_publish();
+}
+
+void setupSteps()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    ttgo->bma->begin();
+
+    //! Lowest rate the step counter works at, averaged rather than performance mode
+    Acfg cfg;
+    cfg.odr = BMA4_OUTPUT_DATA_RATE_50HZ;
+    cfg.range = BMA4_ACCEL_RANGE_2G;
+    cfg.bandwidth = BMA4_ACCEL_NORMAL_AVG4;
+    cfg.perf_mode = BMA4_CIC_AVG_MODE;
+    ttgo->bma->accelConfig(cfg);
+    ttgo->bma->enableAccel();
+
+    ttgo->bma->enableFeature(BMA423_STEP_CNTR, true);
+    if (!bma_feature_update(BMA423_STEP_CNTR_OFFSET, BMA423_STEP_CNTR_WM_MSK, STEPS_WATERMARK)) {
+        Serial.println("Steps: failed to set the step counter watermark");
+    }
+    watermark = bma_feature_read(BMA423_STEP_CNTR_OFFSET) & BMA423_STEP_CNTR_WM_MSK;
+    ttgo->bma->attachInterrupt();
+    ttgo->bma->enableStepCountInterrupt();
+
+    steps = ttgo->bma->getCounter();
+    started = millis();
+    lv_task_create(steps_task, STEPS_POLL_MS, LV_TASK_PRIO_LOWEST, NULL);
+}
+
+void steps_irq(bool screenOn)
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    uint32_t start = micros();
+    irqs++;
+
+    //! Reading the status clears the latched interrupt
+    ttgo->bma->readInterrupt();
+    if (ttgo->bma->isStepCounter()) {
+        steps = ttgo->bma->getCounter();
+    }
+
+    if (screenOn) {
+        steps_publish();
+        return;
+    }
+    sleepWakes++;
+    sleepCurrentSum += (uint32_t)ttgo->power->getBattDischargeCurrent();
+    sleepCurrentSamples++;
+    sleepWakeUs += micros() - start;
+}
+
+void steps_publish()
+{
+    steps_read();
+    if (steps != shown) {
+        shown = steps;
+        updateStepCounter(steps);
+    }
+}
+
+uint32_t steps_read()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    steps = ttgo->bma->getCounter();
+    return steps;
+}
+
+uint32_t steps_count()
+{
+    return steps;
+}
+
+void steps_report()
+{
+    uint32_t hours = (millis() - started) / 3600000;
+    Serial.printf("Steps: %u, %u interrupts, %u while asleep (%u per hour)\n",
+                  steps, irqs, sleepWakes, hours ? sleepWakes / hours : sleepWakes);
+    //! With the watermark in place there should be about one interrupt per watermark * 20 steps
+    Serial.printf("  watermark %u read back (every %u steps), %u steps per interrupt\n",
+                  watermark, watermark * 20, irqs ? steps / irqs : 0);
+    if (sleepWakes) {
+        uint32_t ma = sleepCurrentSum / sleepCurrentSamples;
+        //! Average current those wakes add, spread over the time since boot
+        float addedUa = (float)ma * 1000.0f * (float)sleepWakeUs / ((float)(millis() - started) * 1000.0f);
+        Serial.printf("  %u us awake per sleeping wake at %u mA, adding %.2f uA on average\n",
+                      sleepWakeUs / sleepWakes, ma, addedUa);
+    }
+}
@@ -0,0 +1,223 @@
+#include "config.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <sys/time.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "timekeeper.h"
+#include "rtcdrift.h"
+#include "schedule.h"
+
+/*
+    Intervals are measured on the monotonic esp_timer so that stepping the
+    wall clock, or an NTP sync switching it from local time to UTC, does
+    not disturb them. It runs from the same crystal as the system clock.
+*/
+
+//! Positive ppm means the clock runs fast
+static float sysPpm = 0;
+static float rtcPpm = TIMEKEEPER_RTC_PPM_DEFAULT;
+static bool rtcPpmMeasured = false;
+
+static int64_t lastCorrUs = 0;
+static int64_t lastRefUs = 0;
+static int64_t rtcWrittenUs = 0;
+static int64_t rtcReadUs = 0;
+
+static uint32_t wakes = 0;
+static uint32_t rtcReads = 0;
+static uint32_t rtcWrites = 0;
+static uint32_t rtcWriteSkips = 0;
+static uint32_t references = 0;
+static uint32_t steps = 0;
+static int32_t zoneOffset = 0;
+
+static int64_t now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void set_us(int64_t us)
+{
+    struct timeval tv;
+    tv.tv_sec = us / 1000000;
+    tv.tv_usec = us % 1000000;
+    settimeofday(&tv, NULL);
+}
+
+static void save()
+{
+    Preferences prefs;
+    prefs.begin("clock", false);
+    prefs.putFloat("sysPpm", sysPpm);
+    if (rtcPpmMeasured) {
+        prefs.putFloat("rtcPpm", rtcPpm);
+    }
+    prefs.end();
+}
+
+//! Fold a new drift measurement into the estimate
+static float blend(float estimate, float measured)
+{
+    return estimate * 0.5f + measured * 0.5f;
+}
+
+//! Apply the learned rate to the time elapsed since the last correction
+static void correct()
+{
+    int64_t mono = esp_timer_get_time();
+    int64_t adj = -(int64_t)(sysPpm * (float)(mono - lastCorrUs) / 1e6f);
+    if (adj >= 1000 || adj <= -1000) {
+        set_us(now_us() + adj);
+        lastCorrUs = mono;
+    }
+}
+
+static int64_t rtc_us()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    RTC_Date d = ttgo->rtc->getDateTime();
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    t.tm_year = d.year - 1900;
+    t.tm_mon = d.month - 1;
+    t.tm_mday = d.day;
+    t.tm_hour = d.hour;
+    t.tm_min = d.minute;
+    t.tm_sec = d.second;
+    t.tm_isdst = -1;
+    rtcReads++;
+    //! The RTC only has whole seconds, assume the middle of one
+    return (int64_t)mktime(&t) * 1000000 + 500000;
+}
+
+static float since_rtc_write_s()
+{
+    return (float)(esp_timer_get_time() - rtcWrittenUs) / 1e6f;
+}
+
+void timekeeper_begin()
+{
+    Preferences prefs;
+    prefs.begin("clock", true);
+    sysPpm = prefs.getFloat("sysPpm", 0);
+    rtcPpmMeasured = prefs.isKey("rtcPpm");
+    rtcPpm = prefs.getFloat("rtcPpm", TIMEKEEPER_RTC_PPM_DEFAULT);
+    //! Calendar times from the phone are converted with it before it connects
+    zoneOffset = prefs.getInt("zone", 0);
+    prefs.end();
+
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    ttgo->rtc->syncToSystem();
+    rtcReads++;
+    lastCorrUs = rtcReadUs = rtcWrittenUs = esp_timer_get_time();
+}
+
+void timekeeper_wake()
+{
+    wakes++;
+    correct();
+
+    int64_t mono = esp_timer_get_time();
+    if (mono - rtcReadUs < (int64_t)TIMEKEEPER_RTC_CHECK_S * 1000000) return;
+    if (lastRefUs != 0 && mono - lastRefUs < (int64_t)TIMEKEEPER_RTC_CHECK_S * 1000000) return;
+
+    int64_t rtc = rtc_us();
+    int64_t diff = rtc - now_us();
+    rtcReadUs = mono;
+    if (diff > TIMEKEEPER_STEP_MS * 1000LL || diff < -TIMEKEEPER_STEP_MS * 1000LL) {
+        //! Without a better reference trust the battery backed clock
+        Serial.printf("Clock: system clock off by %lld ms, reloading from RTC\n", -diff / 1000);
+        set_us(rtc);
+        lastCorrUs = mono;
+        steps++;
+        schedule_clock_changed();
+        return;
+    }
+
+    //! The system clock is disciplined, so the difference is the RTC's own drift
+    float elapsed = (float)(mono - rtcWrittenUs) / 1e6f;
+    if (elapsed * TIMEKEEPER_PPM_PRECISION / 1e6f >= 1.0f) {
+        float measured = (float)diff / elapsed;
+        rtcPpm = rtcPpmMeasured ? blend(rtcPpm, measured) : measured;
+        rtcPpmMeasured = true;
+        save();
+    }
+}
+
+void timekeeper_reference(int64_t trueUs, uint32_t resolutionMs, bool updateRtc)
+{
+    correct();
+    int64_t mono = esp_timer_get_time();
+    int64_t offset = now_us() - trueUs;
+    bool stepped = offset > TIMEKEEPER_STEP_MS * 1000LL || offset < -TIMEKEEPER_STEP_MS * 1000LL;
+    references++;
+
+    if (stepped) {
+        //! A first sync or a change of time zone, not drift
+        steps++;
+    } else if (lastRefUs != 0) {
+        float elapsed = (float)(mono - lastRefUs) / 1e6f;
+        //! ppm uncertainty of this baseline is resolution / elapsed
+        if (resolutionMs * 1000.0f <= elapsed * TIMEKEEPER_PPM_PRECISION) {
+            sysPpm = blend(sysPpm, sysPpm + (float)offset / elapsed);
+            save();
+        }
+        Serial.printf("Clock: %lld ms off after %.0f s, system drift %.1f ppm\n",
+                      offset / 1000, elapsed, sysPpm);
+    }
+
+    set_us(trueUs);
+    lastRefUs = lastCorrUs = mono;
+    //! With updateRtc the RTC write below takes care of it
+    if (stepped && !updateRtc) schedule_clock_changed();
+
+    if (!updateRtc) return;
+    if (stepped || rtc_write_due(rtcPpm, since_rtc_write_s(), TIMEKEEPER_RTC_MAX_ERROR_MS)) {
+        timekeeper_write_rtc();
+    } else {
+        rtcWriteSkips++;
+    }
+}
+
+void timekeeper_write_rtc()
+{
+    struct tm info;
+    time_t now = time(nullptr);
+    localtime_r(&now, &info);
+
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    ttgo->rtc->setDateTime(info.tm_year + 1900, info.tm_mon + 1, info.tm_mday, info.tm_hour, info.tm_min, info.tm_sec);
+    rtcWrites++;
+    rtcWrittenUs = rtcReadUs = esp_timer_get_time();
+    //! The alarm registers are in RTC time, a step or a zone change moves them
+    schedule_clock_changed();
+}
+
+void timekeeper_set_zone_offset(int32_t seconds)
+{
+    if (seconds == zoneOffset) return;
+    zoneOffset = seconds;
+    Preferences prefs;
+    prefs.begin("clock", false);
+    prefs.putInt("zone", zoneOffset);
+    prefs.end();
+}
+
+time_t timekeeper_from_utc(time_t utc)
+{
+    const char *zone = getenv("TZ");
+    return zone == nullptr || *zone == '\0' ? utc + zoneOffset : utc;
+}
+
+void timekeeper_report()
+{
+    Serial.println("Clock:");
+    Serial.printf("  system drift %.2f ppm, RTC drift %.2f ppm%s\n", sysPpm, rtcPpm, rtcPpmMeasured ? "" : " (assumed)");
+    Serial.printf("  %u wakes, %u RTC reads, %u RTC writes, %u writes skipped, %u references, %u steps\n",
+                  wakes, rtcReads, rtcWrites, rtcWriteSkips, references, steps);
+    Serial.printf("  predicted RTC drift %u ms, rewritten past %u ms\n",
+                  rtc_drift_ms(rtcPpm, since_rtc_write_s()), TIMEKEEPER_RTC_MAX_ERROR_MS);
+}
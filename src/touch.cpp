@@ -0,0 +1,140 @@
+/*
+    Interrupt driven touch input.
+
+    The library's LVGL input driver asks the FT6236 for a point on every
+    lv_task_handler() pass. This replaces its read_cb with a buffered one:
+    the controller holds TOUCH_INT low while a finger is down, the falling
+    edge wakes a sampling task that reads the controller every
+    TOUCH_SAMPLE_MS until the line goes high again, and read_cb only
+    drains the samples it queued. With nobody touching the watch there is
+    no bus traffic at all. The touch panel has its own I2C bus, so the
+    sampling task doesn't contend with the AXP202/RTC/BMA423 in loop().
+*/
+
+#include "config.h"
+#include <Arduino.h>
+#include "main.h"
+#include "touch.h"
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    bool pressed;
+} touch_sample_t;
+
+static touch_sample_t samples[TOUCH_BUFFER_SIZE];
+static uint8_t head = 0, tail = 0;
+//! Both ends move tail when the ring is full, so both take it
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+static touch_sample_t last = {0, 0, false};
+static TaskHandle_t touchTask = nullptr;
+
+static volatile uint32_t irqUs = 0;
+static bool irqPending = false;
+static uint32_t i2cReads = 0;
+static uint32_t lvglReads = 0;
+static uint32_t gestures = 0;
+static uint32_t latencySumUs = 0;
+static uint32_t latencyMaxUs = 0;
+static uint32_t statsSince = 0;
+
+static void push(int16_t x, int16_t y, bool pressed)
+{
+    portENTER_CRITICAL(&ringMux);
+    uint8_t next = (head + 1) % TOUCH_BUFFER_SIZE;
+    if (next == tail) {
+        //! LVGL isn't draining (screen off), keep the newest samples so the release is never lost
+        tail = (tail + 1) % TOUCH_BUFFER_SIZE;
+    }
+    samples[head].x = x;
+    samples[head].y = y;
+    samples[head].pressed = pressed;
+    head = next;
+    portEXIT_CRITICAL(&ringMux);
+}
+
+static void IRAM_ATTR touch_isr()
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    irqUs = micros();
+    vTaskNotifyGiveFromISR(touchTask, &xHigherPriorityTaskWoken);
+    if (xHigherPriorityTaskWoken) {
+        portYIELD_FROM_ISR ();
+    }
+}
+
+static void touch_task(void *param)
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    int16_t x = 0, y = 0;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (xEventGroupGetBits(*get_isr_group()) & WATCH_FLAG_SLEEP_MODE) {
+            continue;
+        }
+        gestures++;
+        irqPending = true;
+        while (digitalRead(TOUCH_INT) == LOW) {
+            i2cReads++;
+            if (ttgo->getTouch(x, y)) {
+                push(x, y, true);
+            }
+            vTaskDelay(TOUCH_SAMPLE_MS / portTICK_PERIOD_MS);
+        }
+        push(x, y, false);
+    }
+}
+
+static bool touch_read_cb(lv_indev_drv_t *drv, lv_indev_data_t *data)
+{
+    lvglReads++;
+    portENTER_CRITICAL(&ringMux);
+    bool got = tail != head;
+    if (got) {
+        last = samples[tail];
+        tail = (tail + 1) % TOUCH_BUFFER_SIZE;
+    }
+    bool more = tail != head;
+    portEXIT_CRITICAL(&ringMux);
+    if (got && irqPending) {
+        irqPending = false;
+        uint32_t latency = micros() - irqUs;
+        latencySumUs += latency;
+        if (latency > latencyMaxUs) latencyMaxUs = latency;
+    }
+    data->point.x = last.x;
+    data->point.y = last.y;
+    data->state = last.pressed ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
+    return more;
+}
+
+void setupTouch()
+{
+    lv_indev_t *indev = lv_indev_get_next(NULL);
+    while (indev != nullptr && indev->driver.type != LV_INDEV_TYPE_POINTER) {
+        indev = lv_indev_get_next(indev);
+    }
+    if (indev == nullptr) {
+        Serial.println("Touch: no pointer input, keeping the library driver");
+        return;
+    }
+
+    xTaskCreatePinnedToCore(touch_task, "touch", 2048, NULL, 2, &touchTask, 1);
+    pinMode(TOUCH_INT, INPUT);
+    attachInterrupt(TOUCH_INT, touch_isr, FALLING);
+
+    indev->driver.read_cb = touch_read_cb;
+    statsSince = millis();
+}
+
+void touch_report()
+{
+    uint32_t secs = (millis() - statsSince) / 1000;
+    if (secs == 0) secs = 1;
+    Serial.println("Touch:");
+    Serial.printf("  %u gestures, %u I2C reads (%u/s)\n", gestures, i2cReads, i2cReads / secs);
+    Serial.printf("  polling driver would have made %u reads (%u/s)\n", lvglReads, lvglReads / secs);
+    if (gestures) {
+        Serial.printf("  touch to event latency avg %u us, max %u us\n", latencySumUs / gestures, latencyMaxUs);
+    }
+}
@@ -0,0 +1,105 @@
+#include "config.h"
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "steps.h"
+#include "wake.h"
+
+typedef enum {
+    WAKE_SOURCE_NONE,
+    WAKE_SOURCE_TILT,
+    WAKE_SOURCE_TAP,
+} wake_source_t;
+
+static volatile int64_t markUs = 0;
+static wake_source_t pending = WAKE_SOURCE_NONE;
+static wake_source_t shown = WAKE_SOURCE_NONE;
+static uint32_t shownMs = 0;
+
+static uint32_t wakes[3] = {0};
+static uint32_t dismissed[3] = {0};
+static uint32_t untouched[3] = {0};
+static uint32_t stepOnly = 0;
+static uint32_t latencyTotalUs = 0;
+static uint32_t latencyMaxUs = 0;
+static uint32_t latencyCount = 0;
+
+void setupWake()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+#if WAKE_DOUBLE_TAP
+    ttgo->bma->enableFeature(BMA423_WAKEUP, true);
+    //! tap_sel set means double rather than single tap, at the configured
+    //! sensitivity. The WAKEUP interrupt bit is the same for both, so this
+    //! is what keeps isDoubleClick() from also matching single knocks.
+    if (!bma_feature_update(BMA423_WAKEUP_OFFSET, BMA423_WAKEUP_SENS_MSK | BMA423_TAP_SEL_MSK,
+                            (WAKE_TAP_SENSITIVITY << BMA423_WAKEUP_SENS_POS) | BMA423_TAP_SEL_MSK)) {
+        Serial.println("Wake: failed to select double tap");
+    }
+    ttgo->bma->enableWakeupInterrupt();
+#endif
+#if WAKE_TILT
+    ttgo->bma->enableFeature(BMA423_TILT, true);
+    ttgo->bma->enableTiltInterrupt();
+#endif
+}
+
+void IRAM_ATTR wake_mark()
+{
+    markUs = esp_timer_get_time();
+}
+
+bool wake_classify()
+{
+    TTGOClass *ttgo = TTGOClass::getWatch();
+    steps_irq(false);
+    if (ttgo->bma->isTilt()) {
+        pending = WAKE_SOURCE_TILT;
+    } else if (ttgo->bma->isDoubleClick()) {
+        pending = WAKE_SOURCE_TAP;
+    } else {
+        stepOnly++;
+        pending = WAKE_SOURCE_NONE;
+        return false;
+    }
+    wakes[pending]++;
+    return true;
+}
+
+void wake_shown()
+{
+    shown = pending;
+    pending = WAKE_SOURCE_NONE;
+    shownMs = millis();
+    if (shown == WAKE_SOURCE_NONE || markUs == 0) return;
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - markUs);
+    markUs = 0;
+    latencyTotalUs += us;
+    latencyCount++;
+    if (us > latencyMaxUs) latencyMaxUs = us;
+}
+
+void wake_sleeping()
+{
+    if (shown == WAKE_SOURCE_NONE) return;
+    uint32_t onMs = millis() - shownMs;
+    if (onMs <= WAKE_DISMISS_MS) {
+        dismissed[shown]++;
+    }
+    //! Any touch resets LVGL's inactivity timer, so it is younger than the wake
+    if (lv_disp_get_inactive_time(NULL) + WAKE_INTERACT_MARGIN_MS >= onMs) {
+        untouched[shown]++;
+    }
+    shown = WAKE_SOURCE_NONE;
+}
+
+void wake_report()
+{
+    Serial.printf("Wake: tilt %u (%u dismissed, %u without touch), double tap %u (%u dismissed, %u without touch), "
+                  "%u step interrupts while asleep\n",
+                  wakes[WAKE_SOURCE_TILT], dismissed[WAKE_SOURCE_TILT], untouched[WAKE_SOURCE_TILT],
+                  wakes[WAKE_SOURCE_TAP], dismissed[WAKE_SOURCE_TAP], untouched[WAKE_SOURCE_TAP], stepOnly);
+    if (latencyCount) {
+        Serial.printf("  interrupt to backlight avg %u us, max %u us\n", latencyTotalUs / latencyCount, latencyMaxUs);
+    }
+}
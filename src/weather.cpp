@@ -0,0 +1,279 @@
+#include "config.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+#include "fonts.h"
+#include "weather.h"
+
+typedef enum {
+    WEATHER_CLEAR,
+    WEATHER_FEW_CLOUDS,
+    WEATHER_CLOUDS,
+    WEATHER_RAIN,
+    WEATHER_STORM,
+    WEATHER_SNOW,
+    WEATHER_FOG,
+    WEATHER_ICONS,
+} weather_icon_t;
+
+typedef struct {
+    int8_t icon;
+    uint32_t lastUsed;
+    lv_img_dsc_t dsc;
+    uint8_t data[WEATHER_ICON_SIZE * WEATHER_ICON_SIZE];
+} icon_slot_t;
+
+static weather_t weather;
+
+static icon_slot_t iconSlots[WEATHER_ICON_SLOTS];
+static uint32_t iconTick = 0;
+
+static lv_obj_t *weatherCont = nullptr;
+static lv_obj_t *weatherImg = nullptr;
+static lv_obj_t *weatherLabel = nullptr;
+//! What the complication shows now, the label points at it
+static char shownText[48];
+static int8_t shownIcon = -1;
+
+static uint32_t messages = 0;
+static uint32_t unchanged = 0;
+static uint32_t saves = 0;
+static uint32_t redraws = 0;
+static uint32_t iconHits = 0;
+static uint32_t iconMisses = 0;
+static uint32_t iconDecodeUs = 0;
+
+static weather_icon_t icon_for(uint16_t code)
+{
+    if (code >= 200 && code < 300) return WEATHER_STORM;
+    if (code >= 300 && code < 600) return WEATHER_RAIN;
+    if (code >= 600 && code < 700) return WEATHER_SNOW;
+    if (code >= 700 && code < 800) return WEATHER_FOG;
+    if (code == 801 || code == 802) return WEATHER_FEW_CLOUDS;
+    if (code > 802) return WEATHER_CLOUDS;
+    return WEATHER_CLEAR;
+}
+
+//! Keep the larger coverage, edge is the distance inside the shape in pixels
+static inline void cover(uint8_t *buf, int x, int y, float edge)
+{
+    if (edge <= -0.5f) return;
+    uint8_t a = edge >= 0.5f ? 255 : (uint8_t)((edge + 0.5f) * 255);
+    uint8_t *p = &buf[y * WEATHER_ICON_SIZE + x];
+    if (a > *p) *p = a;
+}
+
+static void paint_circle(uint8_t *buf, float cx, float cy, float r)
+{
+    for (int y = 0; y < WEATHER_ICON_SIZE; y++) {
+        for (int x = 0; x < WEATHER_ICON_SIZE; x++) {
+            float dx = x + 0.5f - cx, dy = y + 0.5f - cy;
+            cover(buf, x, y, r - sqrtf(dx * dx + dy * dy));
+        }
+    }
+}
+
+static void paint_line(uint8_t *buf, float x0, float y0, float x1, float y1, float width)
+{
+    float vx = x1 - x0, vy = y1 - y0;
+    float len2 = vx * vx + vy * vy;
+    for (int y = 0; y < WEATHER_ICON_SIZE; y++) {
+        for (int x = 0; x < WEATHER_ICON_SIZE; x++) {
+            float px = x + 0.5f - x0, py = y + 0.5f - y0;
+            float t = len2 > 0 ? (px * vx + py * vy) / len2 : 0;
+            t = t < 0 ? 0 : t > 1 ? 1 : t;
+            float dx = px - t * vx, dy = py - t * vy;
+            cover(buf, x, y, width / 2 - sqrtf(dx * dx + dy * dy));
+        }
+    }
+}
+
+static void paint_sun(uint8_t *buf, float cx, float cy, float r)
+{
+    paint_circle(buf, cx, cy, r);
+    for (int i = 0; i < 8; i++) {
+        float a = i * PI / 4;
+        float c = cosf(a), s = sinf(a);
+        paint_line(buf, cx + c * (r + 3), cy + s * (r + 3), cx + c * (r + 6), cy + s * (r + 6), 2);
+    }
+}
+
+static void paint_cloud(uint8_t *buf, float dy)
+{
+    paint_circle(buf, 11, 17 + dy, 6);
+    paint_circle(buf, 18, 13 + dy, 8);
+    paint_circle(buf, 24, 18 + dy, 5);
+    paint_line(buf, 11, 20 + dy, 24, 20 + dy, 6);
+}
+
+//! Rasterize one icon, only done on a cache miss
+static void paint(uint8_t *buf, weather_icon_t icon)
+{
+    memset(buf, 0, WEATHER_ICON_SIZE * WEATHER_ICON_SIZE);
+    switch (icon) {
+    case WEATHER_CLEAR:
+        paint_sun(buf, 16, 16, 7);
+        break;
+    case WEATHER_FEW_CLOUDS:
+        paint_sun(buf, 11, 10, 5);
+        paint_cloud(buf, 4);
+        break;
+    case WEATHER_CLOUDS:
+        paint_cloud(buf, 0);
+        break;
+    case WEATHER_RAIN:
+        paint_cloud(buf, -4);
+        for (int i = 0; i < 3; i++) {
+            paint_line(buf, 11 + i * 6, 23, 9 + i * 6, 29, 2);
+        }
+        break;
+    case WEATHER_STORM:
+        paint_cloud(buf, -4);
+        paint_line(buf, 18, 21, 14, 26, 2);
+        paint_line(buf, 14, 26, 19, 26, 2);
+        paint_line(buf, 19, 26, 15, 31, 2);
+        break;
+    case WEATHER_SNOW:
+        paint_cloud(buf, -4);
+        for (int i = 0; i < 3; i++) {
+            paint_circle(buf, 10 + i * 6, 25 + (i & 1) * 3, 1.5f);
+        }
+        break;
+    case WEATHER_FOG:
+        for (int i = 0; i < 4; i++) {
+            paint_line(buf, 5 + (i & 1) * 3, 9 + i * 5, 27 - (i & 1) * 3, 9 + i * 5, 2);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static const lv_img_dsc_t *get_icon(weather_icon_t icon)
+{
+    icon_slot_t *slot = &iconSlots[0];
+    for (int i = 0; i < WEATHER_ICON_SLOTS; i++) {
+        if (iconSlots[i].icon == icon) {
+            iconHits++;
+            iconSlots[i].lastUsed = ++iconTick;
+            return &iconSlots[i].dsc;
+        }
+        if (iconSlots[i].lastUsed < slot->lastUsed) slot = &iconSlots[i];
+    }
+
+    iconMisses++;
+    uint32_t start = micros();
+    if (slot->icon >= 0) {
+        //! LVGL may still have the old pixels cached under this descriptor
+        lv_img_cache_invalidate_src(&slot->dsc);
+    }
+    paint(slot->data, icon);
+    slot->icon = icon;
+    slot->lastUsed = ++iconTick;
+    slot->dsc.header.always_zero = 0;
+    slot->dsc.header.w = WEATHER_ICON_SIZE;
+    slot->dsc.header.h = WEATHER_ICON_SIZE;
+    slot->dsc.header.cf = LV_IMG_CF_ALPHA_8BIT;
+    slot->dsc.data_size = sizeof(slot->data);
+    slot->dsc.data = slot->data;
+    iconDecodeUs += micros() - start;
+    return &slot->dsc;
+}
+
+//! Work out what the complication would show and touch it only if that changed
+static void refresh()
+{
+    if (weatherCont == nullptr) return;
+    if (weather.updated == 0) {
+        lv_obj_set_hidden(weatherCont, true);
+        return;
+    }
+
+    char text[sizeof(shownText)];
+    snprintf(text, sizeof(text), "%d\xC2\xB0" "C %s\nH %d\xC2\xB0  L %d\xC2\xB0",
+             weather.temp, weather.text, weather.hi, weather.lo);
+    weather_icon_t icon = icon_for(weather.code);
+    if (icon == shownIcon && !strcmp(text, shownText)) return;
+
+    redraws++;
+    if (icon != shownIcon) {
+        shownIcon = icon;
+        lv_img_set_src(weatherImg, get_icon(icon));
+    }
+    if (strcmp(text, shownText)) {
+        strcpy(shownText, text);
+        lv_label_set_text_static(weatherLabel, shownText);
+    }
+    lv_obj_set_hidden(weatherCont, false);
+}
+
+void setupWeather()
+{
+    for (int i = 0; i < WEATHER_ICON_SLOTS; i++) {
+        iconSlots[i].icon = -1;
+    }
+    Preferences prefs;
+    prefs.begin("weather", true);
+    if (prefs.getBytesLength("last") == sizeof(weather)) {
+        prefs.getBytes("last", &weather, sizeof(weather));
+    }
+    prefs.end();
+}
+
+void weather_create(lv_obj_t *parent)
+{
+    weatherCont = lv_cont_create(parent, NULL);
+    lv_obj_set_style_local_bg_opa(weatherCont, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, LV_OPA_0);
+    lv_obj_set_style_local_border_width(weatherCont, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 0);
+    lv_obj_set_style_local_pad_inner(weatherCont, LV_CONT_PART_MAIN, LV_STATE_DEFAULT, 8);
+    lv_cont_set_layout(weatherCont, LV_LAYOUT_ROW_MID);
+    lv_cont_set_fit(weatherCont, LV_FIT_TIGHT);
+
+    weatherImg = lv_img_create(weatherCont, NULL);
+    lv_obj_set_style_local_image_recolor(weatherImg, LV_IMG_PART_MAIN, LV_STATE_DEFAULT, LV_COLOR_WHITE);
+    weatherLabel = lv_label_create(weatherCont, NULL);
+    //! The degree sign and the phone's condition text are outside the built-in font's ASCII
+    lv_obj_set_style_local_text_font(weatherLabel, LV_LABEL_PART_MAIN, LV_STATE_DEFAULT, font_text());
+    lv_label_set_text_static(weatherLabel, shownText);
+    lv_obj_align(weatherCont, NULL, LV_ALIGN_IN_TOP_MID, 0, 100);
+
+    shownIcon = -1;
+    shownText[0] = '\0';
+    refresh();
+}
+
+void weather_update(const weather_t *w)
+{
+    messages++;
+    //! Everything but the timestamp, so a repeated report is not written again
+    bool same = weather.updated != 0 &&
+                !memcmp((const uint8_t *)&weather + sizeof(weather.updated),
+                        (const uint8_t *)w + sizeof(w->updated), sizeof(weather) - sizeof(weather.updated));
+    weather = *w;
+    weather.updated = (uint32_t)time(nullptr);
+    if (same) {
+        unchanged++;
+    } else {
+        Preferences prefs;
+        prefs.begin("weather", false);
+        prefs.putBytes("last", &weather, sizeof(weather));
+        prefs.end();
+        saves++;
+    }
+    refresh();
+}
+
+const weather_t *weather_get()
+{
+    return &weather;
+}
+
+void weather_report()
+{
+    Serial.printf("Weather: %u messages, %u unchanged, %u saved, %u redraws\n", messages, unchanged, saves, redraws);
+    Serial.printf("  icons %u hits, %u misses, %u us drawing\n", iconHits, iconMisses, iconDecodeUs);
+    if (weather.updated) {
+        Serial.printf("  %d C %s in %s, %u s old\n", weather.temp, weather.text, weather.location,
+                      (uint32_t)time(nullptr) - weather.updated);
+    }
+}
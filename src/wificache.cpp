@@ -0,0 +1,339 @@
+#include "config.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <Preferences.h>
+#include <time.h>
+#include "wificache.h"
+
+typedef struct {
+    char ssid[33];
+    char password[64];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t mask;
+    uint32_t dns;
+    //! Wall clock seconds when the address was leased, 0 if unknown
+    uint32_t leased;
+} wifi_cache_entry_t;
+
+typedef enum {
+    WIFI_PATH_NONE,
+    WIFI_PATH_FULL,
+    WIFI_PATH_CHANNEL,
+    WIFI_PATH_STATIC,
+} wifi_path_t;
+
+static const char *const pathNames[] = {"none", "full", "bssid+channel", "bssid+channel+ip"};
+
+//! Most recently used first
+static wifi_cache_entry_t entries[WIFI_CACHE_ENTRIES];
+static wifi_cache_entry_t pending;
+static wifi_path_t path = WIFI_PATH_NONE;
+static uint32_t attemptStart = 0;
+
+static uint32_t radioStart = 0;
+static uint32_t radioOnMs = 0;
+static bool radioOn = false;
+
+static uint32_t attempts = 0;
+static uint32_t pathCount[4] = {0};
+static uint32_t pathMs[4] = {0};
+static uint32_t fallbacks = 0;
+static uint32_t probes = 0;
+static uint32_t probeFailures = 0;
+static uint32_t lastProbeMs = 0;
+static uint32_t lastConnectMs = 0;
+
+//! Set from the WiFi event task, handled by wifi_cache_poll()
+static volatile bool gotIp = false;
+static WiFiUDP probeUdp;
+static bool probing = false;
+static uint16_t probeId = 0;
+static uint32_t probeStart = 0;
+
+static void save()
+{
+    Preferences prefs;
+    prefs.begin("wifi", false);
+    prefs.putBytes("cache", entries, sizeof(entries));
+    prefs.end();
+}
+
+static int find(const char *ssid)
+{
+    for (int i = 0; i < WIFI_CACHE_ENTRIES; i++) {
+        if (entries[i].ssid[0] != '\0' && !strcmp(entries[i].ssid, ssid)) return i;
+    }
+    return -1;
+}
+
+//! Move entry i to the front, or make room there for a new one
+static void promote(int i)
+{
+    wifi_cache_entry_t e;
+    if (i < 0) {
+        i = WIFI_CACHE_ENTRIES - 1;
+        memset(&e, 0, sizeof(e));
+    } else {
+        e = entries[i];
+    }
+    memmove(&entries[1], &entries[0], i * sizeof(entries[0]));
+    entries[0] = e;
+}
+
+static bool lease_valid(const wifi_cache_entry_t *e)
+{
+    if (e->ip == 0 || e->leased == 0) return false;
+    uint32_t now = (uint32_t)time(nullptr);
+    return now >= e->leased && now - e->leased < WIFI_CACHE_LEASE_S;
+}
+
+static void begin(wifi_path_t p)
+{
+    path = p;
+    attempts++;
+    attemptStart = millis();
+    WiFi.mode(WIFI_STA);
+    WiFi.disconnect();
+    if (p == WIFI_PATH_STATIC) {
+        WiFi.config(IPAddress(pending.ip), IPAddress(pending.gateway), IPAddress(pending.mask), IPAddress(pending.dns));
+    } else {
+        //! Back to DHCP
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+    if (p == WIFI_PATH_FULL) {
+        WiFi.begin(pending.ssid, pending.password);
+    } else {
+        WiFi.begin(pending.ssid, pending.password, pending.channel, pending.bssid);
+    }
+}
+
+//! Ask the DNS server for a name, any answer proves that replies reach our address
+static bool probe_send(uint32_t server)
+{
+    //! Header with recursion desired, then one question: pool.ntp.org IN A
+    static const uint8_t question[] = {
+        4, 'p', 'o', 'o', 'l', 3, 'n', 't', 'p', 3, 'o', 'r', 'g', 0, 0, 1, 0, 1,
+    };
+    uint8_t query[12 + sizeof(question)];
+    probeId = (uint16_t)esp_random();
+    memset(query, 0, 12);
+    query[0] = probeId >> 8;
+    query[1] = probeId;
+    query[2] = 0x01;
+    query[5] = 1;
+    memcpy(query + 12, question, sizeof(question));
+
+    probes++;
+    probeStart = millis();
+    probing = probeUdp.begin(0) && probeUdp.beginPacket(IPAddress(server), 53) &&
+              probeUdp.write(query, sizeof(query)) == sizeof(query) && probeUdp.endPacket();
+    if (!probing) {
+        probeUdp.stop();
+    }
+    return probing;
+}
+
+//! True once the reply is in, never blocks
+static bool probe_received()
+{
+    uint8_t reply[12];
+    if (probeUdp.parsePacket() < 12 || probeUdp.read(reply, sizeof(reply)) != sizeof(reply)) return false;
+    //! Same id and a response, whatever the answer
+    return reply[0] == (probeId >> 8) && reply[1] == (probeId & 0xFF) && (reply[2] & 0x80);
+}
+
+static void probe_stop()
+{
+    probeUdp.stop();
+    probing = false;
+    lastProbeMs = millis() - probeStart;
+}
+
+void setupWifiCache()
+{
+    Preferences prefs;
+    prefs.begin("wifi", true);
+    if (prefs.getBytesLength("cache") == sizeof(entries)) {
+        prefs.getBytes("cache", entries, sizeof(entries));
+    }
+    prefs.end();
+}
+
+void wifi_connect(const char *ssid, const char *password)
+{
+    int i = ssid != nullptr ? find(ssid) : 0;
+    if (ssid == nullptr && entries[0].ssid[0] == '\0') {
+        //! Nothing cached yet, use what the WiFi driver remembers
+        memset(&pending, 0, sizeof(pending));
+        path = WIFI_PATH_FULL;
+        attempts++;
+        attemptStart = millis();
+        WiFi.begin();
+        return;
+    }
+
+    if (i >= 0) {
+        pending = entries[i];
+        if (password != nullptr && strcmp(password, pending.password)) {
+            //! New credentials, the cached lease may belong to another setup
+            strlcpy(pending.password, password, sizeof(pending.password));
+            pending.channel = 0;
+        }
+    } else {
+        memset(&pending, 0, sizeof(pending));
+        strlcpy(pending.ssid, ssid, sizeof(pending.ssid));
+        strlcpy(pending.password, password != nullptr ? password : "", sizeof(pending.password));
+    }
+
+    if (pending.channel == 0) {
+        begin(WIFI_PATH_FULL);
+    } else if (lease_valid(&pending)) {
+        begin(WIFI_PATH_STATIC);
+    } else {
+        begin(WIFI_PATH_CHANNEL);
+    }
+}
+
+bool wifi_cache_known(const char *ssid)
+{
+    return find(ssid) >= 0;
+}
+
+void wifi_cache_got_ip()
+{
+    gotIp = true;
+}
+
+//! The reused address does not get replies: the lease is gone or reassigned
+static void probe_failed(uint32_t server)
+{
+    probeFailures++;
+    Serial.printf("WiFi: no reply from %s in %u ms, falling back to a full connect\n",
+                  IPAddress(server).toString().c_str(), lastProbeMs);
+    fallbacks++;
+    int i = find(pending.ssid);
+    if (i >= 0) {
+        entries[i].ip = 0;
+        save();
+    }
+    pending.ip = 0;
+    begin(WIFI_PATH_FULL);
+}
+
+static void connected()
+{
+    lastConnectMs = millis() - attemptStart;
+    pathCount[path]++;
+    pathMs[path] += lastConnectMs;
+    Serial.printf("WiFi: connected via %s in %u ms, radio on for %u ms\n", pathNames[path], lastConnectMs,
+                  radioOn ? millis() - radioStart : 0);
+
+    if (pending.ssid[0] == '\0') {
+        strlcpy(pending.ssid, WiFi.SSID().c_str(), sizeof(pending.ssid));
+        strlcpy(pending.password, WiFi.psk().c_str(), sizeof(pending.password));
+    }
+    memcpy(pending.bssid, WiFi.BSSID(), sizeof(pending.bssid));
+    pending.channel = WiFi.channel();
+    if (path != WIFI_PATH_STATIC) {
+        pending.ip = WiFi.localIP();
+        pending.gateway = WiFi.gatewayIP();
+        pending.mask = WiFi.subnetMask();
+        pending.dns = WiFi.dnsIP();
+        pending.leased = (uint32_t)time(nullptr);
+    }
+    path = WIFI_PATH_NONE;
+
+    promote(find(pending.ssid));
+    entries[0] = pending;
+    save();
+}
+
+bool wifi_cache_poll()
+{
+    uint32_t server = pending.dns != 0 ? pending.dns : pending.gateway;
+    if (gotIp) {
+        gotIp = false;
+        if (probing) probe_stop();
+        if (path == WIFI_PATH_NONE) return true;
+        if (path != WIFI_PATH_STATIC) {
+            connected();
+            return true;
+        }
+        if (!probe_send(server)) {
+            lastProbeMs = 0;
+            probe_failed(server);
+        }
+        return false;
+    }
+    if (!probing) return false;
+    if (path != WIFI_PATH_STATIC) {
+        //! The event task already gave up on this attempt
+        probe_stop();
+        return false;
+    }
+    if (probe_received()) {
+        probe_stop();
+        connected();
+        return true;
+    }
+    if (millis() - probeStart >= WIFI_CACHE_PROBE_MS) {
+        probe_stop();
+        probe_failed(server);
+    }
+    return false;
+}
+
+void wifi_cache_disconnected(uint8_t reason)
+{
+    //! Our own disconnect before a new attempt
+    if (reason == WIFI_REASON_ASSOC_LEAVE) return;
+    if (path == WIFI_PATH_NONE || path == WIFI_PATH_FULL) {
+        path = WIFI_PATH_NONE;
+        return;
+    }
+    //! Could not associate with the cached access point, forget it and scan
+    Serial.printf("WiFi: %s connect failed (reason %u), falling back to a full connect\n", pathNames[path], reason);
+    fallbacks++;
+    int i = find(pending.ssid);
+    if (i >= 0) {
+        entries[i].channel = 0;
+        entries[i].ip = 0;
+        save();
+    }
+    pending.channel = 0;
+    pending.ip = 0;
+    begin(WIFI_PATH_FULL);
+}
+
+void wifi_cache_radio(bool on)
+{
+    if (on && !radioOn) {
+        radioStart = millis();
+    } else if (!on && radioOn) {
+        uint32_t ms = millis() - radioStart;
+        radioOnMs += ms;
+        Serial.printf("WiFi: radio was on for %u ms\n", ms);
+    }
+    radioOn = on;
+}
+
+void wifi_cache_report()
+{
+    uint32_t onMs = radioOnMs + (radioOn ? millis() - radioStart : 0);
+    Serial.printf("WiFi: %u attempts, %u fallbacks, last connect %u ms, radio on %u ms total\n",
+                  attempts, fallbacks, lastConnectMs, onMs);
+    Serial.printf("  %u address probes, %u failed, last %u ms\n", probes, probeFailures, lastProbeMs);
+    for (int p = WIFI_PATH_FULL; p <= WIFI_PATH_STATIC; p++) {
+        if (pathCount[p] == 0) continue;
+        Serial.printf("  %-18s n=%-4u avg %u ms\n", pathNames[p], pathCount[p], pathMs[p] / pathCount[p]);
+    }
+    for (int i = 0; i < WIFI_CACHE_ENTRIES; i++) {
+        if (entries[i].ssid[0] == '\0') continue;
+        Serial.printf("  cached %-20s ch %-2u %s%s\n", entries[i].ssid, entries[i].channel,
+                      IPAddress(entries[i].ip).toString().c_str(), lease_valid(&entries[i]) ? "" : " (stale)");
+    }
+}
@@ -0,0 +1,111 @@
+#include "config.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include "wificache.h"
+#include "wifiscan.h"
+
+static wifi_scan_result_t results[WIFI_SCAN_MAX];
+static int resultCount = 0;
+static uint32_t stamp = 0;
+static bool valid = false;
+
+static uint32_t scans = 0;
+static uint32_t lastRaw = 0;
+static uint32_t dropped = 0;
+static uint32_t cacheHits = 0;
+
+//! Known networks first, then strongest signal
+static bool before(const wifi_scan_result_t *a, const wifi_scan_result_t *b)
+{
+    if (a->known != b->known) return a->known;
+    return a->rssi > b->rssi;
+}
+
+void wifi_scan_collect()
+{
+    int16_t len = WiFi.scanComplete();
+    resultCount = 0;
+    lastRaw = 0;
+    scans++;
+    for (int i = 0; i < len; i++) {
+        const wifi_ap_record_t *ap = (const wifi_ap_record_t *)WiFi.getScanInfoByIndex(i);
+        if (ap == nullptr || ap->ssid[0] == '\0') continue;
+        lastRaw++;
+
+        int j = 0;
+        while (j < resultCount && strcmp(results[j].ssid, (const char *)ap->ssid)) {
+            j++;
+        }
+        if (j < resultCount) {
+            //! Another access point of the same network
+            results[j].aps++;
+            if (ap->rssi > results[j].rssi) results[j].rssi = ap->rssi;
+            continue;
+        }
+
+        wifi_scan_result_t r;
+        strlcpy(r.ssid, (const char *)ap->ssid, sizeof(r.ssid));
+        r.rssi = ap->rssi;
+        r.aps = 1;
+        r.secure = ap->authmode != WIFI_AUTH_OPEN;
+        r.known = wifi_cache_known(r.ssid);
+        if (resultCount == WIFI_SCAN_MAX) {
+            //! Full, replace the weakest entry if this one sorts ahead of it
+            dropped++;
+            if (!before(&r, &results[resultCount - 1])) continue;
+            resultCount--;
+        }
+        results[resultCount++] = r;
+
+        //! Keep the table sorted so the weakest entry is always last
+        for (int k = resultCount - 1; k > 0 && before(&results[k], &results[k - 1]); k--) {
+            wifi_scan_result_t t = results[k];
+            results[k] = results[k - 1];
+            results[k - 1] = t;
+        }
+    }
+    //! The aggregated copy is all we need, free the driver's records
+    WiFi.scanDelete();
+    stamp = millis();
+    valid = len >= 0;
+
+    //! Merging may have raised an entry's RSSI, sort once more
+    for (int i = 1; i < resultCount; i++) {
+        for (int k = i; k > 0 && before(&results[k], &results[k - 1]); k--) {
+            wifi_scan_result_t t = results[k];
+            results[k] = results[k - 1];
+            results[k - 1] = t;
+        }
+    }
+}
+
+bool wifi_scan_fresh()
+{
+    if (!valid || millis() - stamp > WIFI_SCAN_CACHE_MS) return false;
+    cacheHits++;
+    return true;
+}
+
+void wifi_scan_invalidate()
+{
+    valid = false;
+}
+
+int wifi_scan_count()
+{
+    return resultCount;
+}
+
+const wifi_scan_result_t *wifi_scan_get(int i)
+{
+    return i >= 0 && i < resultCount ? &results[i] : nullptr;
+}
+
+void wifi_scan_report()
+{
+    Serial.printf("WiFi scan: %u scans, %u served from cache, %u networks dropped\n", scans, cacheHits, dropped);
+    Serial.printf("  last scan %u access points collapsed to %d networks\n", lastRaw, resultCount);
+    if (valid) {
+        Serial.printf("  taken %u ms ago\n", millis() - stamp);
+    }
+}
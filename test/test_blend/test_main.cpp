@@ -0,0 +1,225 @@
+/*
+    Checks and times the RGB565 kernels from lib/blend565 against LVGL's
+    per-pixel loops (lv_color_fill and lv_color_mix, copied below).
+
+        pio test -e native -f test_blend
+        pio test -e ttgo-t-watch-2020 -f test_blend
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include "blend565.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+static uint32_t now_us()
+{
+    return micros();
+}
+#else
+#include <chrono>
+static uint32_t now_us()
+{
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+//! One 240 pixel line, as LVGL hands them over, a few screens' worth
+#define BENCH_LINE  240
+#define BENCH_ROWS  (240 * 4)
+
+static uint16_t dst[BENCH_LINE + 1];
+static uint16_t ref[BENCH_LINE + 1];
+static uint16_t src[BENCH_LINE];
+
+//! LVGL 7's lv_color_mix() for 16 bit color
+static uint16_t lv_mix(uint16_t c1, uint16_t c2, uint8_t mix)
+{
+#define UDIV255(x) (((uint32_t)(x) * 0x8081) >> 0x17)
+    uint32_t r = UDIV255((c1 >> 11) * mix + (c2 >> 11) * (255 - mix));
+    uint32_t g = UDIV255(((c1 >> 5) & 0x3F) * mix + ((c2 >> 5) & 0x3F) * (255 - mix));
+    uint32_t b = UDIV255((c1 & 0x1F) * mix + (c2 & 0x1F) * (255 - mix));
+    return (r << 11) | (g << 5) | b;
+#undef UDIV255
+}
+
+static void generic_map(uint16_t *d, const uint16_t *s, uint32_t length, uint8_t opa)
+{
+    if (opa >= BLEND565_OPA_MAX) {
+        for (uint32_t i = 0; i < length; i++) d[i] = s[i];
+    } else if (opa > BLEND565_OPA_MIN) {
+        for (uint32_t i = 0; i < length; i++) d[i] = lv_mix(s[i], d[i], opa);
+    }
+}
+
+static void fill_inputs()
+{
+    srand(1);
+    for (int i = 0; i < BENCH_LINE; i++) {
+        src[i] = (uint16_t)rand();
+        dst[i] = ref[i] = (uint16_t)rand();
+    }
+}
+
+//! Keep the compiler from dropping or merging the timed rows
+static inline void clobber()
+{
+    __asm__ __volatile__("" ::: "memory");
+}
+
+static int channel_error(uint16_t a, uint16_t b)
+{
+    int e[3] = {abs((a >> 11) - (b >> 11)), abs(((a >> 5) & 0x3F) - ((b >> 5) & 0x3F)), abs((a & 0x1F) - (b & 0x1F))};
+    int m = e[0] > e[1] ? e[0] : e[1];
+    return m > e[2] ? m : e[2];
+}
+
+static void report(const char *what, uint32_t genericUs, uint32_t kernelUs)
+{
+    char line[96];
+    snprintf(line, sizeof(line), "%-10s generic %7u us, kernel %7u us (%d px)", what, genericUs, kernelUs, BENCH_LINE * BENCH_ROWS);
+    TEST_MESSAGE(line);
+}
+
+static void test_fill()
+{
+    for (int offset = 0; offset < 2; offset++) {
+        for (uint32_t len = 0; len < 8; len++) {
+            memset(dst, 0, sizeof(dst));
+            blend565_fill(dst + offset, len, 0xA5C3);
+            for (uint32_t i = 0; i < BENCH_LINE + 1; i++) {
+                bool inside = i >= (uint32_t)offset && i < offset + len;
+                TEST_ASSERT_EQUAL_HEX16(inside ? 0xA5C3 : 0, dst[i]);
+            }
+        }
+    }
+
+    uint32_t start = now_us();
+    for (int r = 0; r < BENCH_ROWS; r++) {
+        for (int i = 0; i < BENCH_LINE; i++) ref[i] = 0x1234 + r;
+        clobber();
+    }
+    uint32_t g = now_us() - start;
+    start = now_us();
+    for (int r = 0; r < BENCH_ROWS; r++) {
+        blend565_fill(dst, BENCH_LINE, 0x1234 + r);
+        clobber();
+    }
+    uint32_t k = now_us() - start;
+    TEST_ASSERT_EQUAL_HEX16_ARRAY(ref, dst, BENCH_LINE);
+    report("fill", g, k);
+}
+
+static void check_map(uint8_t opa)
+{
+    fill_inputs();
+    generic_map(ref, src, BENCH_LINE, opa);
+    blend565_map<false>(dst, src, BENCH_LINE, opa);
+    //! The kernels mix in 1/32 steps, LVGL in 1/255
+    for (int i = 0; i < BENCH_LINE; i++) {
+        TEST_ASSERT_LESS_OR_EQUAL(2, channel_error(ref[i], dst[i]));
+    }
+
+    //! The swapped variant gives the same pixels, byte swapped
+    uint16_t plain[BENCH_LINE];
+    fill_inputs();
+    blend565_map<false>(dst, src, BENCH_LINE, opa);
+    memcpy(plain, dst, sizeof(plain));
+    fill_inputs();
+    for (int i = 0; i < BENCH_LINE; i++) {
+        src[i] = __builtin_bswap16(src[i]);
+        dst[i] = __builtin_bswap16(dst[i]);
+    }
+    blend565_map<true>(dst, src, BENCH_LINE, opa);
+    for (int i = 0; i < BENCH_LINE; i++) {
+        TEST_ASSERT_EQUAL_HEX16(plain[i], __builtin_bswap16(dst[i]));
+    }
+}
+
+static void bench_map(uint8_t opa)
+{
+    check_map(opa);
+    fill_inputs();
+    uint32_t start = now_us();
+    for (int r = 0; r < BENCH_ROWS; r++) {
+        generic_map(ref, src, BENCH_LINE, opa);
+        clobber();
+    }
+    uint32_t g = now_us() - start;
+    start = now_us();
+    for (int r = 0; r < BENCH_ROWS; r++) {
+        blend565_map<false>(dst, src, BENCH_LINE, opa);
+        clobber();
+    }
+    uint32_t k = now_us() - start;
+    char what[16];
+    snprintf(what, sizeof(what), "map opa %u", opa);
+    report(what, g, k);
+}
+
+static void test_map_cover()
+{
+    bench_map(255);
+}
+
+static void test_map_opa_20()
+{
+    bench_map(BLEND565_OPA_20);
+}
+
+static void test_map_opa_50()
+{
+    bench_map(BLEND565_OPA_50);
+}
+
+static void test_map_opa_70()
+{
+    bench_map(BLEND565_OPA_70);
+}
+
+static void test_map_opa_other()
+{
+    //! Not specialised, goes through the runtime opacity loop
+    bench_map(102);
+}
+
+static void test_map_transparent()
+{
+    fill_inputs();
+    blend565_map<false>(dst, src, BENCH_LINE, 0);
+    TEST_ASSERT_EQUAL_HEX16_ARRAY(ref, dst, BENCH_LINE);
+}
+
+static int run_tests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fill);
+    RUN_TEST(test_map_cover);
+    RUN_TEST(test_map_opa_20);
+    RUN_TEST(test_map_opa_50);
+    RUN_TEST(test_map_opa_70);
+    RUN_TEST(test_map_opa_other);
+    RUN_TEST(test_map_transparent);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    //! Give the test runner time to open the serial port
+    delay(2000);
+    run_tests();
+}
+
+void loop()
+{
+}
+#else
+int main(int argc, char **argv)
+{
+    return run_tests();
+}
+#endif
@@ -0,0 +1,276 @@
+/*
+    NtpClient against a stand-in NTP server on a local UDP socket. The
+    client gets a POSIX socket transport and a fake clock that advances
+    10 ms per poll, so timeouts take no real time.
+
+        pio test -e native -f test_ntp
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+#include "ntpclient.h"
+
+#define TICK_MS     10
+//! Server clock ahead of the client
+#define SERVER_OFFSET_US    1500000LL
+
+typedef enum {
+    SERVER_REPLY,
+    SERVER_SILENT,
+    SERVER_KOD,
+    //! A reply to some other request, then the real one
+    SERVER_BAD_ORIGIN,
+} server_mode_t;
+
+static int64_t fakeUs = 1600000000LL * 1000000;
+static uint32_t fakeMs = 1000;
+static int clientSock = -1;
+static int serverSock = -1;
+static uint16_t serverPort = 0;
+static server_mode_t modes[NTP_MAX_ATTEMPTS];
+static int requests = 0;
+
+static bool done = false;
+static bool doneOk = false;
+static int64_t doneOffset = 0;
+
+/*****************************************************************
+ *
+ *          ! POSIX transport
+ *
+ */
+static ntp_resolve_t host_resolve(const char *host, uint32_t *ip)
+{
+    struct in_addr addr;
+    if (inet_pton(AF_INET, host, &addr) != 1) return NTP_RESOLVE_FAIL;
+    *ip = addr.s_addr;
+    return NTP_RESOLVE_OK;
+}
+
+static bool host_send(uint32_t ip, uint16_t port, const uint8_t *buf, int len)
+{
+    if (clientSock < 0) {
+        clientSock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (clientSock < 0) return false;
+        fcntl(clientSock, F_SETFL, O_NONBLOCK);
+    }
+    struct sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = ip;
+    to.sin_port = htons(port);
+    return sendto(clientSock, buf, len, 0, (struct sockaddr *)&to, sizeof(to)) == len;
+}
+
+static int host_recv(uint8_t *buf, int len)
+{
+    if (clientSock < 0) return 0;
+    int n = recv(clientSock, buf, len, 0);
+    return n > 0 ? n : 0;
+}
+
+static void host_close()
+{
+    if (clientSock >= 0) {
+        close(clientSock);
+        clientSock = -1;
+    }
+}
+
+static int64_t host_now_us()
+{
+    return fakeUs;
+}
+
+static uint32_t host_millis()
+{
+    return fakeMs;
+}
+
+static const ntp_transport_t hostTransport = {
+    host_resolve,
+    host_send,
+    host_recv,
+    host_close,
+    host_now_us,
+    host_millis,
+};
+
+/*****************************************************************
+ *
+ *          ! Stand-in server
+ *
+ */
+static void put_timestamp(uint8_t *p, int64_t us)
+{
+    uint32_t sec = (uint32_t)(us / 1000000 + 2208988800ULL);
+    uint32_t frac = (uint32_t)(((uint64_t)(us % 1000000) << 32) / 1000000);
+    p[0] = sec >> 24; p[1] = sec >> 16; p[2] = sec >> 8; p[3] = sec;
+    p[4] = frac >> 24; p[5] = frac >> 16; p[6] = frac >> 8; p[7] = frac;
+}
+
+static void server_open()
+{
+    serverSock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(serverSock, (struct sockaddr *)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(serverSock, (struct sockaddr *)&addr, &len);
+    serverPort = ntohs(addr.sin_port);
+    fcntl(serverSock, F_SETFL, O_NONBLOCK);
+}
+
+static void server_step()
+{
+    uint8_t req[NTP_PACKET_SIZE];
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    if (recvfrom(serverSock, req, sizeof(req), 0, (struct sockaddr *)&from, &fromLen) != NTP_PACKET_SIZE) return;
+    server_mode_t mode = modes[requests < NTP_MAX_ATTEMPTS ? requests : NTP_MAX_ATTEMPTS - 1];
+    requests++;
+    if (mode == SERVER_SILENT) return;
+
+    uint8_t reply[NTP_PACKET_SIZE];
+    memset(reply, 0, sizeof(reply));
+    reply[0] = (4 << 3) | 4;
+    reply[1] = 2;
+    memcpy(reply + 24, req + 40, 8);
+    put_timestamp(reply + 32, fakeUs + SERVER_OFFSET_US);
+    put_timestamp(reply + 40, fakeUs + SERVER_OFFSET_US);
+    if (mode == SERVER_KOD) {
+        reply[1] = 0;
+        memcpy(reply + 12, "RATE", 4);
+    }
+    if (mode == SERVER_BAD_ORIGIN) {
+        //! A stale reply, shifted by a minute so accepting it would show
+        uint8_t stale[NTP_PACKET_SIZE];
+        memcpy(stale, reply, sizeof(stale));
+        stale[27] ^= 0x55;
+        put_timestamp(stale + 32, fakeUs + 60000000LL);
+        put_timestamp(stale + 40, fakeUs + 60000000LL);
+        sendto(serverSock, stale, sizeof(stale), 0, (struct sockaddr *)&from, fromLen);
+    }
+    sendto(serverSock, reply, sizeof(reply), 0, (struct sockaddr *)&from, fromLen);
+}
+
+/*****************************************************************
+ *
+ *          ! Tests
+ *
+ */
+static void done_cb(bool ok, int64_t offsetUs)
+{
+    done = true;
+    doneOk = ok;
+    doneOffset = offsetUs;
+}
+
+static NtpClient client(&hostTransport);
+static const char *const servers[] = {"127.0.0.1", "127.0.0.1"};
+
+//! Run the client until it calls back, returns the fake milliseconds it took
+static uint32_t run(server_mode_t first, server_mode_t rest)
+{
+    modes[0] = first;
+    for (int i = 1; i < NTP_MAX_ATTEMPTS; i++) modes[i] = rest;
+    requests = 0;
+    done = false;
+    client.setServers(servers, 2, serverPort);
+    uint32_t start = fakeMs;
+    client.begin(done_cb);
+    for (int i = 0; i < 100000 && !done; i++) {
+        client.poll();
+        //! Let loopback deliver before the server and then the client look
+        usleep(100);
+        server_step();
+        usleep(100);
+        fakeMs += TICK_MS;
+        fakeUs += TICK_MS * 1000;
+    }
+    return fakeMs - start;
+}
+
+static void test_reply()
+{
+    run(SERVER_REPLY, SERVER_REPLY);
+    TEST_ASSERT_TRUE(done);
+    TEST_ASSERT_TRUE(doneOk);
+    TEST_ASSERT_EQUAL(0, client.attempts());
+    //! Half a tick of the fake round trip is taken as path delay
+    TEST_ASSERT_INT64_WITHIN(TICK_MS * 1000, SERVER_OFFSET_US, doneOffset);
+    TEST_ASSERT_FALSE(client.busy());
+}
+
+static void test_timeout()
+{
+    uint32_t ms = run(SERVER_SILENT, SERVER_SILENT);
+    TEST_ASSERT_TRUE(done);
+    TEST_ASSERT_FALSE(doneOk);
+    TEST_ASSERT_EQUAL(NTP_MAX_ATTEMPTS, client.attempts());
+    TEST_ASSERT_EQUAL(NTP_MAX_ATTEMPTS, requests);
+    //! Every attempt waited out its timeout, with backoff in between
+    TEST_ASSERT_TRUE(ms >= NTP_MAX_ATTEMPTS * NTP_TIMEOUT_MS);
+}
+
+static void test_kiss_of_death()
+{
+    uint32_t ms = run(SERVER_KOD, SERVER_REPLY);
+    TEST_ASSERT_TRUE(doneOk);
+    TEST_ASSERT_EQUAL(2, requests);
+    TEST_ASSERT_EQUAL(1, client.attempts());
+    TEST_ASSERT_INT64_WITHIN(TICK_MS * 1000, SERVER_OFFSET_US, doneOffset);
+    //! Moved on at once instead of waiting for the timeout
+    TEST_ASSERT_TRUE(ms < NTP_TIMEOUT_MS);
+
+    //! A server that only ever says go away is a failure, not a time
+    run(SERVER_KOD, SERVER_KOD);
+    TEST_ASSERT_FALSE(doneOk);
+    TEST_ASSERT_EQUAL(NTP_MAX_ATTEMPTS, requests);
+}
+
+static void test_bad_origin()
+{
+    run(SERVER_BAD_ORIGIN, SERVER_BAD_ORIGIN);
+    TEST_ASSERT_TRUE(doneOk);
+    TEST_ASSERT_EQUAL(1, requests);
+    //! The minute-off reply with the wrong origin was ignored, the real one is read a tick later
+    TEST_ASSERT_INT64_WITHIN(2 * TICK_MS * 1000, SERVER_OFFSET_US, doneOffset);
+}
+
+static void test_parse_rejects()
+{
+    uint8_t buf[NTP_PACKET_SIZE];
+    int64_t offset, delay;
+    memset(buf, 0, sizeof(buf));
+    buf[0] = (4 << 3) | 4;
+    buf[1] = 2;
+    put_timestamp(buf + 24, fakeUs);
+    TEST_ASSERT_TRUE(NtpClient::parseResponse(buf, sizeof(buf), fakeUs, fakeUs, &offset, &delay));
+    TEST_ASSERT_FALSE(NtpClient::parseResponse(buf, sizeof(buf) - 1, fakeUs, fakeUs, &offset, &delay));
+    buf[0] = (3 << 6) | (4 << 3) | 4;
+    TEST_ASSERT_FALSE(NtpClient::parseResponse(buf, sizeof(buf), fakeUs, fakeUs, &offset, &delay));
+    buf[0] = (4 << 3) | 3;
+    TEST_ASSERT_FALSE(NtpClient::parseResponse(buf, sizeof(buf), fakeUs, fakeUs, &offset, &delay));
+}
+
+int main(int argc, char **argv)
+{
+    server_open();
+    UNITY_BEGIN();
+    RUN_TEST(test_reply);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_kiss_of_death);
+    RUN_TEST(test_bad_origin);
+    RUN_TEST(test_parse_rejects);
+    close(serverSock);
+    return UNITY_END();
+}
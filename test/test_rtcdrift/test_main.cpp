@@ -0,0 +1,70 @@
+/*
+    RTC write decision against a day of phone time syncs, counting writes
+    and skips the way timekeeper_reference() does.
+
+        pio test -e native -f test_rtcdrift
+*/
+
+#include <unity.h>
+#include "rtcdrift.h"
+#include "timekeeper.h"
+
+//! The phone sends the time on every connect
+#define SYNC_INTERVAL_S     600
+#define DAY_S               (24 * 3600)
+
+static void replay(float ppm, uint32_t *writes, uint32_t *skips)
+{
+    float sinceWrite = 0;
+    *writes = *skips = 0;
+    for (int t = SYNC_INTERVAL_S; t <= DAY_S; t += SYNC_INTERVAL_S) {
+        sinceWrite += SYNC_INTERVAL_S;
+        if (rtc_write_due(ppm, sinceWrite, TIMEKEEPER_RTC_MAX_ERROR_MS)) {
+            (*writes)++;
+            sinceWrite = 0;
+        } else {
+            (*skips)++;
+        }
+    }
+}
+
+static void test_drift()
+{
+    TEST_ASSERT_EQUAL_UINT32(0, rtc_drift_ms(20.0f, 0));
+    TEST_ASSERT_EQUAL_UINT32(72, rtc_drift_ms(20.0f, 3600));
+    TEST_ASSERT_EQUAL_UINT32(72, rtc_drift_ms(-20.0f, 3600));
+}
+
+//! The whole-second rounding alone must not force a write
+static void test_fresh_write_skipped()
+{
+    TEST_ASSERT_FALSE(rtc_write_due(TIMEKEEPER_RTC_PPM_DEFAULT, 50, TIMEKEEPER_RTC_MAX_ERROR_MS));
+    TEST_ASSERT_FALSE(rtc_write_due(TIMEKEEPER_RTC_PPM_DEFAULT, 3600, TIMEKEEPER_RTC_MAX_ERROR_MS));
+}
+
+static void test_default_ppm_day()
+{
+    uint32_t writes, skips;
+    replay(TIMEKEEPER_RTC_PPM_DEFAULT, &writes, &skips);
+    //! 20 ppm passes 500 ms about every 7 hours
+    TEST_ASSERT_EQUAL_UINT32(3, writes);
+    TEST_ASSERT_EQUAL_UINT32(DAY_S / SYNC_INTERVAL_S - 3, skips);
+}
+
+static void test_bad_crystal_day()
+{
+    uint32_t writes, skips;
+    replay(200.0f, &writes, &skips);
+    TEST_ASSERT_GREATER_THAN_UINT32(20, writes);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, skips);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_drift);
+    RUN_TEST(test_fresh_write_skipped);
+    RUN_TEST(test_default_ppm_day);
+    RUN_TEST(test_bad_crystal_day);
+    return UNITY_END();
+}
@@ -0,0 +1,40 @@
+"""PlatformIO extra script: `pio run -t uploadassets` exports the library's
+images with tools/exportimages.py, packs them and anything in assets/ with
+tools/mkassets.py and writes the result to the assets partition, leaving
+the firmware alone."""
+
+import csv
+import os
+
+Import('env')
+
+PROJECT = env.subst('$PROJECT_DIR')
+LIBDEPS = os.path.join(env.subst('$PROJECT_LIBDEPS_DIR'), env.subst('$PIOENV'))
+EXPORTED = os.path.join(env.subst('$BUILD_DIR'), 'assets')
+OUT = os.path.join(env.subst('$BUILD_DIR'), 'assets.bin')
+TOOLS = os.path.join(PROJECT, 'tools')
+
+
+def assets_partition():
+    with open(os.path.join(PROJECT, env.GetProjectOption('board_build.partitions'))) as f:
+        for row in csv.reader(line for line in f if not line.lstrip().startswith('#')):
+            row = [c.strip() for c in row]
+            if row and row[0] == 'assets':
+                return row[3], row[4]
+    raise SystemExit('No assets partition in the partition table')
+
+
+offset, size = assets_partition()
+env.AddCustomTarget(
+    name='uploadassets',
+    dependencies=None,
+    actions=[
+        '"$PYTHONEXE" "%s" "%s" "%s"' % (os.path.join(TOOLS, 'exportimages.py'), LIBDEPS, EXPORTED),
+        '"$PYTHONEXE" "%s" "%s" "%s" "%s" --size %s' % (os.path.join(TOOLS, 'mkassets.py'),
+                                                        os.path.join(PROJECT, 'assets'), EXPORTED, OUT, size),
+        '"$PYTHONEXE" "$UPLOADER" --chip esp32 --port "$UPLOAD_PORT" --baud $UPLOAD_SPEED write_flash %s "%s"'
+        % (offset, OUT),
+    ],
+    title='Upload assets',
+    description='Export the library images, pack them with assets/ and write the assets partition',
+)
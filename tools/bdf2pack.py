@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""Convert a BDF bitmap font into a font pack for src/fonts.cpp.
+
+The pack goes on SPIFFS as /font.pack, for example by copying it to the
+data/ directory and running `pio run -t uploadfs`. Pick a font with the
+same pixel size as the compiled-in text font, e.g. GNU Unifont for 16 px.
+
+    tools/bdf2pack.py unifont.bdf data/font.pack --ranges 0x80-0x24f,0x370-0x3ff,0x3000-0x9fff
+
+See include/fonts.h for the layout.
+"""
+
+import argparse
+import struct
+import sys
+
+
+def parse_ranges(text):
+    ranges = []
+    for part in text.split(','):
+        lo, _, hi = part.partition('-')
+        lo = int(lo, 0)
+        ranges.append((lo, int(hi, 0) if hi else lo))
+    return ranges
+
+
+def parse_bdf(path):
+    glyphs = {}
+    ascent = descent = 0
+    with open(path, encoding='latin-1') as f:
+        lines = iter(f.read().splitlines())
+    for line in lines:
+        words = line.split()
+        if not words:
+            continue
+        if words[0] == 'FONT_ASCENT':
+            ascent = int(words[1])
+        elif words[0] == 'FONT_DESCENT':
+            descent = int(words[1])
+        elif words[0] == 'STARTCHAR':
+            code = -1
+            advance = 0
+            w = h = x = y = 0
+            rows = []
+            for line in lines:
+                words = line.split()
+                if words[0] == 'ENCODING':
+                    code = int(words[-1])
+                elif words[0] == 'DWIDTH':
+                    advance = int(words[1])
+                elif words[0] == 'BBX':
+                    w, h, x, y = (int(v) for v in words[1:5])
+                elif words[0] == 'BITMAP':
+                    for line in lines:
+                        if line.startswith('ENDCHAR'):
+                            break
+                        rows.append(int(line, 16) >> (len(line) * 4 - w) if w else 0)
+                    break
+            if code >= 0:
+                glyphs[code] = (advance, w, h, x, y, rows)
+    return ascent, descent, glyphs
+
+
+def pack_bits(w, rows):
+    """Rows back to back, one bit per pixel, no padding between rows"""
+    out = bytearray()
+    acc = bits = 0
+    for row in rows:
+        for i in range(w - 1, -1, -1):
+            acc = (acc << 1) | ((row >> i) & 1)
+            bits += 1
+            if bits == 8:
+                out.append(acc)
+                acc = bits = 0
+    if bits:
+        out.append(acc << (8 - bits))
+    return bytes(out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('bdf')
+    ap.add_argument('out')
+    ap.add_argument('--ranges', default='0x80-0xffff', help='code point ranges to include')
+    ap.add_argument('--max-bytes', type=int, default=128, help='skip glyphs bigger than FONT_GLYPH_MAX_BYTES')
+    args = ap.parse_args()
+
+    ranges = parse_ranges(args.ranges)
+    ascent, descent, glyphs = parse_bdf(args.bdf)
+    codes = sorted(c for c in glyphs if any(lo <= c <= hi for lo, hi in ranges))
+
+    entries = []
+    bitmaps = bytearray()
+    skipped = 0
+    for c in codes:
+        advance, w, h, x, y, rows = glyphs[c]
+        bitmap = pack_bits(w, rows)
+        if len(bitmap) > args.max_bytes or w > 255 or h > 255:
+            skipped += 1
+            continue
+        entries.append((c, len(bitmaps), advance, w, h, x, y))
+        bitmaps += bitmap
+
+    blocks = []
+    for i, entry in enumerate(entries):
+        block = entry[0] >> 8
+        if blocks and blocks[-1][0] == block:
+            blocks[-1][2] += 1
+        else:
+            blocks.append([block, i, 1])
+    if len(blocks) > 512:
+        sys.exit('%d blocks, FONT_MAX_BLOCKS is 512, use fewer ranges' % len(blocks))
+
+    base = 20 + len(blocks) * 12 + len(entries) * 16
+    with open(args.out, 'wb') as f:
+        f.write(struct.pack('<4sHhB3xII', b'WFP1', ascent + descent, descent, 1, len(blocks), len(entries)))
+        for block in blocks:
+            f.write(struct.pack('<III', *block))
+        for c, offset, advance, w, h, x, y in entries:
+            f.write(struct.pack('<IIBBBbb3x', c, base + offset, advance, w, h, x, y))
+        f.write(bitmaps)
+
+    print('%s: %d glyphs in %d blocks, %d skipped, %d bytes' %
+          (args.out, len(entries), len(blocks), skipped, base + len(bitmaps)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Export LVGL C image arrays as LVGL .bin files for tools/mkassets.py.
+
+The wallpapers and icons the GUI uses come with the TWatch library as
+LVGL image converter C files (const lv_img_dsc_t bg = {...}). This finds
+the images the firmware asks for with ASSET_SRC(name, ...) in those files
+and writes each as name.bin: the 4 byte lv_img_header_t and the pixel
+data of the 16 bit color variant.
+
+    tools/exportimages.py .pio/libdeps/ttgo-t-watch-2020 .pio/build/ttgo-t-watch-2020/assets
+
+`pio run -t uploadassets` runs it first, see tools/assets_build.py.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+CF = {
+    'LV_IMG_CF_RAW': 1,
+    'LV_IMG_CF_RAW_ALPHA': 2,
+    'LV_IMG_CF_RAW_CHROMA_KEYED': 3,
+    'LV_IMG_CF_TRUE_COLOR': 4,
+    'LV_IMG_CF_TRUE_COLOR_ALPHA': 5,
+    'LV_IMG_CF_TRUE_COLOR_CHROMA_KEYED': 6,
+    'LV_IMG_CF_INDEXED_1BIT': 7,
+    'LV_IMG_CF_INDEXED_2BIT': 8,
+    'LV_IMG_CF_INDEXED_4BIT': 9,
+    'LV_IMG_CF_INDEXED_8BIT': 10,
+    'LV_IMG_CF_ALPHA_1BIT': 11,
+    'LV_IMG_CF_ALPHA_2BIT': 12,
+    'LV_IMG_CF_ALPHA_4BIT': 13,
+    'LV_IMG_CF_ALPHA_8BIT': 14,
+}
+
+DESCRIPTOR = re.compile(r'lv_img_dsc_t\s+(\w+)\s*=\s*\{(.*?)\};', re.S)
+MAP = r'uint8_t\s+%s\s*\[\s*\]\s*=\s*\{(.*?)\};'
+
+
+def strip_comments(text):
+    return re.sub(r'/\*.*?\*/|//[^\n]*', ' ', text, flags=re.S)
+
+
+def eval_condition(expr, macros):
+    """Evaluate the #if expressions the image converter writes."""
+    expr = re.sub(r'\b[A-Z_][A-Z0-9_]*\b', lambda m: str(macros.get(m.group(0), 0)), expr)
+    expr = expr.replace('&&', ' and ').replace('||', ' or ').replace('!=', '<>').replace('!', ' not ').replace('<>', '!=')
+    if not re.fullmatch(r'[\d\s()=!<>andortn]*', expr):
+        sys.exit('Cannot evaluate #if %s' % expr)
+    return bool(eval(expr))
+
+
+def preprocess(text, macros):
+    """Keep the lines of the #if branches that apply."""
+    out = []
+    stack = []
+    for line in text.splitlines():
+        s = line.strip()
+        active = all(taken for taken, _ in stack)
+        if s.startswith('#if'):
+            if s.startswith('#ifdef') or s.startswith('#ifndef'):
+                name = s.split()[1]
+                cond = (name in macros) == s.startswith('#ifdef')
+            else:
+                cond = eval_condition(s[3:], macros)
+            stack.append((cond, cond))
+        elif s.startswith('#elif'):
+            _, done = stack.pop()
+            cond = not done and eval_condition(s[5:], macros)
+            stack.append((cond, done or cond))
+        elif s.startswith('#else'):
+            _, done = stack.pop()
+            stack.append((not done, True))
+        elif s.startswith('#endif'):
+            stack.pop()
+        elif not s.startswith('#') and active:
+            out.append(line)
+    return '\n'.join(out)
+
+
+def field(body, name):
+    m = re.search(r'\.%s\s*=\s*([^,}]+)' % re.escape(name), body)
+    return m.group(1).strip() if m else None
+
+
+def export(path, wanted, macros):
+    with open(path, encoding='utf-8', errors='replace') as f:
+        text = preprocess(strip_comments(f.read()), macros)
+    images = {}
+    for name, body in DESCRIPTOR.findall(text):
+        if name not in wanted:
+            continue
+        cf, w, h, data = (field(body, k) for k in ('header.cf', 'header.w', 'header.h', 'data'))
+        if None in (cf, w, h, data) or cf not in CF:
+            print('%s: %s is not in a layout this understands, skipped' % (path, name))
+            continue
+        m = re.search(MAP % re.escape(data.lstrip('&')), text, re.S)
+        if m is None:
+            print('%s: no pixel array %s for %s, skipped' % (path, data, name))
+            continue
+        pixels = bytes(int(b, 16) for b in re.findall(r'0x([0-9a-fA-F]{1,2})\b', m.group(1)))
+        header = CF[cf] | (int(w, 0) << 10) | (int(h, 0) << 21)
+        images[name] = struct.pack('<I', header) + pixels
+    return images
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('lib', help='directory searched for image C files')
+    ap.add_argument('out')
+    ap.add_argument('--src', default=os.path.join(os.path.dirname(__file__), '..', 'src'),
+                    help='sources whose ASSET_SRC() names are exported')
+    ap.add_argument('--swap', action='store_true', help='export the LV_COLOR_16_SWAP variant')
+    args = ap.parse_args()
+
+    wanted = set()
+    for fn in os.listdir(args.src):
+        if fn.endswith(('.c', '.cpp')):
+            with open(os.path.join(args.src, fn), encoding='utf-8', errors='replace') as f:
+                wanted.update(re.findall(r'ASSET_SRC\(\s*(\w+)', f.read()))
+
+    macros = {'LV_COLOR_DEPTH': 16, 'LV_COLOR_16_SWAP': 1 if args.swap else 0, 'LV_COLOR_SIZE': 16}
+    found = {}
+    for root, dirs, files in os.walk(args.lib):
+        dirs[:] = [d for d in dirs if not d.startswith('.')]
+        for fn in files:
+            if fn.endswith(('.c', '.cpp')):
+                found.update(export(os.path.join(root, fn), wanted - set(found), macros))
+
+    os.makedirs(args.out, exist_ok=True)
+    total = 0
+    for name in sorted(found):
+        with open(os.path.join(args.out, name + '.bin'), 'wb') as f:
+            f.write(found[name])
+        total += len(found[name]) - 4
+    missing = sorted(wanted - set(found))
+    print('Exported %d images, %d bytes of pixels no longer linked into the firmware' % (len(found), total))
+    if missing:
+        print('Not found, the GUI uses its fallback symbols: %s' % ' '.join(missing))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""Pack images into an image for the assets partition, see src/assets.cpp.
+
+Every file in the input directories becomes an asset named after the file
+without its extension, so assets/bg.png is ASSET_SRC(bg, ...) in the code.
+When several directories have the same name the first one wins, so your
+own assets/ overrides the images exported from the library.
+PNG and other images Pillow can read are converted to 16 bit true color,
+with an alpha byte per pixel when the image has transparency. LVGL .bin
+files from the online image converter are stored as they are.
+
+    tools/exportimages.py .pio/libdeps/ttgo-t-watch-2020 build/assets
+    tools/mkassets.py assets build/assets assets.bin
+    esptool.py write_flash 0x610000 assets.bin
+
+`pio run -t uploadassets` does all three, see tools/assets_build.py.
+
+See include/assets.h for the layout.
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b'WAS1'
+HEADER = struct.Struct('<4sIII')
+ENTRY = struct.Struct('<IIII24s')
+NAME_SIZE = 24
+MAX_ASSETS = 48
+
+CF_TRUE_COLOR = 4
+CF_TRUE_COLOR_ALPHA = 5
+
+
+def asset_id(name):
+    """FNV-1a, the same as asset_id() in include/assets.h."""
+    h = 2166136261
+    for b in name.encode():
+        h = ((h ^ b) * 16777619) & 0xffffffff
+    return h
+
+
+def img_header(cf, w, h):
+    return cf | (w << 10) | (h << 21)
+
+
+def convert_image(path, swap):
+    try:
+        from PIL import Image
+    except ImportError:
+        sys.exit('Pillow is needed to convert %s: pip install pillow' % path)
+    im = Image.open(path)
+    alpha = im.mode in ('RGBA', 'LA', 'PA') or 'transparency' in im.info
+    im = im.convert('RGBA')
+    w, h = im.size
+    if w >= 2048 or h >= 2048:
+        sys.exit('%s: %dx%d is too large' % (path, w, h))
+    out = bytearray()
+    for r, g, b, a in im.getdata():
+        c = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3)
+        out += struct.pack('>H' if swap else '<H', c)
+        if alpha:
+            out.append(a)
+    return img_header(CF_TRUE_COLOR_ALPHA if alpha else CF_TRUE_COLOR, w, h), bytes(out)
+
+
+def read_bin(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < 4:
+        sys.exit('%s: not an LVGL image' % path)
+    return struct.unpack('<I', data[:4])[0], data[4:]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('dirs', nargs='+', metavar='dir')
+    ap.add_argument('out')
+    ap.add_argument('--swap', action='store_true', help='swap the bytes of 16 bit colors (LV_COLOR_16_SWAP)')
+    ap.add_argument('--size', type=lambda s: int(s, 0), help='fail if the image is larger than the partition')
+    args = ap.parse_args()
+
+    dirs = [d for d in args.dirs if os.path.isdir(d)]
+    if not dirs:
+        sys.exit('None of %s exist, run tools/exportimages.py or add images to assets/' % ' '.join(args.dirs))
+    assets = {}
+    for d in dirs:
+        taken = set()
+        for fn in sorted(os.listdir(d)):
+            path = os.path.join(d, fn)
+            name, ext = os.path.splitext(fn)
+            if not os.path.isfile(path) or fn.startswith('.'):
+                continue
+            if len(name.encode()) >= NAME_SIZE:
+                sys.exit('%s: name longer than %d bytes' % (path, NAME_SIZE - 1))
+            if name in taken:
+                sys.exit('%s: more than one file named %s' % (path, name))
+            taken.add(name)
+            if name in assets:
+                continue
+            if ext.lower() == '.bin':
+                assets[name] = read_bin(path)
+            else:
+                assets[name] = convert_image(path, args.swap)
+
+    if len(assets) > MAX_ASSETS:
+        sys.exit('%d assets, at most %d fit (ASSET_MAX)' % (len(assets), MAX_ASSETS))
+    ids = {}
+    for name in assets:
+        i = asset_id(name)
+        if i in ids:
+            sys.exit('%s and %s have the same id, rename one' % (name, ids[i]))
+        ids[i] = name
+
+    offset = HEADER.size + ENTRY.size * len(assets)
+    index = bytearray()
+    data = bytearray()
+    for i in sorted(ids):
+        name = ids[i]
+        header, pixels = assets[name]
+        pad = -(offset + len(data)) % 4
+        data += b'\0' * pad
+        index += ENTRY.pack(i, offset + len(data), len(pixels), header, name.encode())
+        data += pixels
+        print('%-24s %08x %4dx%-4d %7d bytes' % (name, i, (header >> 10) & 0x7ff, header >> 21, len(pixels)))
+
+    size = offset + len(data)
+    if args.size is not None and size > args.size:
+        sys.exit('%d bytes do not fit the %d byte partition' % (size, args.size))
+    with open(args.out, 'wb') as f:
+        f.write(HEADER.pack(MAGIC, len(assets), size, 0))
+        f.write(index)
+        f.write(data)
+    print('%d assets, %d bytes' % (len(assets), size))
+
+
+if __name__ == '__main__':
+    main()